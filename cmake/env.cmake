@@ -8,3 +8,12 @@ set(EXECUTABLE_OUTPUT_PATH ${PROJECT_BINARY_DIR}/bin)
 #set(CMAKE_CXX_FLAGS "--std=c++14 -g -fmax-errors=1")
 set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} --std=c++17 -g -fdiagnostics-show-template-tree -fmax-errors=1 -ftemplate-backtrace-limit=1")
 
+# world height in blocks, must be a multiple of 16 (128, 256 or 384)
+if (WORLD_HEIGHT)
+  add_definitions(-DWORLD_HEIGHT=${WORLD_HEIGHT})
+endif (WORLD_HEIGHT)
+
+# voxel order inside a section: Linear, YMajor or Morton (see src/Layout.h)
+if (VOXEL_LAYOUT)
+  add_definitions(-DVOXEL_LAYOUT=${VOXEL_LAYOUT})
+endif (VOXEL_LAYOUT)
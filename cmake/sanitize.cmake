@@ -0,0 +1,6 @@
+# build with a sanitizer, e.g. -DSANITIZE=thread for the worker and snapshot tests
+if (SANITIZE)
+	message(STATUS "SANITIZE ${SANITIZE}")
+	set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} -fsanitize=${SANITIZE} -fno-omit-frame-pointer")
+	set(CMAKE_EXE_LINKER_FLAGS "${CMAKE_EXE_LINKER_FLAGS} -fsanitize=${SANITIZE}")
+endif (SANITIZE)
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+#include <glm/common.hpp>
+
+/// the blocks p with min <= p < max, in world or chunk-local coordinates
+struct Box {
+  glm::ivec3 min {0, 0, 0};
+  glm::ivec3 max {0, 0, 0};
+
+  bool empty() const {
+    return min.x >= max.x || min.y >= max.y || min.z >= max.z;
+  }
+
+  glm::ivec3 size() const { return max - min; }
+
+  bool contains(glm::ivec3 p) const {
+    return p.x >= min.x && p.y >= min.y && p.z >= min.z && p.x < max.x && p.y < max.y && p.z < max.z;
+  }
+
+  Box intersect(const Box& o) const {
+    return {glm::max(min, o.min), glm::min(max, o.max)};
+  }
+
+  Box offset(glm::ivec3 d) const {
+    return {min + d, max + d};
+  }
+};
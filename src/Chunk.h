@@ -1,123 +1,786 @@
+#pragma once
+
 #include "Config.h"
 #include "Terrain.h"
+#include "Section.h"
+#include "Light.h"
+#include "Pool.h"
+#include "Box.h"
+#include "Visibility.h"
 
 #include <GLFW/glfw3.h>
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 
 #include <array>
-#include <functional>
+#include <memory>
 #include <vector>
 #include <cassert>
 
+/// a face, or a rectangle of faces, in two words and chunk coordinates. the chunk's origin is not in here:
+/// World::build keeps the instances of a chunk together and each run is drawn with its origin as a uniform.
+///   face:  x | z << 4 | y << 8 | direction << 17 | block << 20
+///   shade: light | (width - 1) << 8 | (height - 1) << 12
 struct Instance {
-  Instance(glm::vec3 p, GLuint d, GLuint ti):
-      x(p.x), y(p.y), z(p.z), direction(d), texture_index(ti) {}
-  float x;
-  float y;
-  float z;
-
-  //FIXME: use GLuchar for both direction and texture_index
-  GLuint direction; // 0 .. 5 = x, y, z, -x, -y, -z
-  GLuint texture_index;
-} __attribute__((packed));
-
-struct Chunk {
-  std::array<std::array<std::array<u_char, CHUNK_SIZE>, CHUNK_HEIGHT>, CHUNK_SIZE> data {}; // zero init in cpp
-  
-  enum class State {                                    /* Generated_Trees == Generated */
-    Exists = 0, Generated_Ground = 1, Generated_Caves = 2, Generated_Trees = 3, Generated = 3, Built = 4
+  Instance(glm::ivec3 local, GLuint d, GLuint ti, GLuint l, int w = 1, int h = 1):
+      face(GLuint(local.x) | GLuint(local.z) << 4 | GLuint(local.y) << 8 | d << 17 | ti << 20),
+      shade(l | GLuint(w - 1) << 8 | GLuint(h - 1) << 12) {}
+  GLuint face;
+  GLuint shade;
+
+  int x() const { return face & 15; }
+  int y() const { return face >> 8 & 511; }
+  int z() const { return face >> 4 & 15; }
+  GLuint direction() const { return face >> 17 & 7; } // 0 .. 5 = x, y, z, -x, -y, -z
+  GLuint texture_index() const { return face >> 20; }
+  GLuint light() const { return shade & 0xFF; } // Light of the voxel the face looks into, sky << 4 | block
+
+  /// faces covered along the two axes of the face: for a normal along axis n, axes (n + 1) % 3 and (n + 2) % 3.
+  ///   a merged rectangle never leaves its section, so 16 is as large as either gets
+  int width() const { return (shade >> 8 & 15) + 1; }
+  int height() const { return (shade >> 12 & 15) + 1; }
+};
+static_assert(sizeof(Instance) == 8, "an instance is two words");
+static_assert(CHUNK_HEIGHT <= 512 && Terrain::BLOCK_COUNT <= 256, "an instance packs y in 9 bits and the block in 8");
+
+using Mesh = std::vector<Instance, MeshAllocator<Instance>>;
+
+/// the blocks on one side of a column, which is all the mesher reads of the column across it: which of them
+/// are opaque or liquid and what light they hold. side 0 .. 3 faces +x, +z, -x, -z, like Chunk::NEIGHBOURS.
+///   bit t of a row is the block at k = t on the x sides and at i = t on the z sides
+struct Edge {
+  std::array<uint16_t, CHUNK_HEIGHT> opaque {};
+  std::array<uint16_t, CHUNK_HEIGHT> liquid {};
+  std::array<u_char, CHUNK_HEIGHT * CHUNK_SIZE> light {}; // block t at height j is at j * CHUNK_SIZE + t
+
+  /// the sections with a row that other has different, 0 if the two are the same
+  uint32_t differ(const Edge& other) const {
+    uint32_t sections = 0;
+    for (int j = 0; j < CHUNK_HEIGHT; ++j) {
+      if (opaque[j] != other.opaque[j] || liquid[j] != other.liquid[j]
+          || not std::equal(&light[j * CHUNK_SIZE], &light[(j + 1) * CHUNK_SIZE], &other.light[j * CHUNK_SIZE])) {
+        sections |= 1u << (j / SECTION_SIZE);
+      }
+    }
+    return sections;
+  }
+};
+
+/// the voxels of a chunk: its sections, occupancy rows and the mesher that reads them.
+/// copying a Column shares its sections copy-on-write, which is how snapshots are taken.
+struct Column {
+  static constexpr uint32_t ALL_SECTIONS = (uint64_t(1) << SECTION_COUNT) - 1; // bit s for section s
+
+  std::array<Section, SECTION_COUNT> _sections; // bottom to top, all air until written
+  std::array<LightSection, SECTION_COUNT> _light; // dark until the column is lit, see Light.h
+
+  /// the sections with a face that can touch a voxel at height j: its own, and the one above or below
+  /// if it is on that edge
+  static uint32_t sectionsAround(int j) {
+    uint32_t around = 1u << (j / SECTION_SIZE);
+    around |= j + 1 < CHUNK_HEIGHT ? 1u << ((j + 1) / SECTION_SIZE) : 0;
+    around |= j > 0 ? 1u << ((j - 1) / SECTION_SIZE) : 0;
+    return around;
+  }
+
+  u_char get(int i, int j, int k) const {
+    return _sections[j / SECTION_SIZE].get(i, j % SECTION_SIZE, k);
+  }
+
+  void set(int i, int j, int k, u_char block) {
+    _sections[j / SECTION_SIZE].set(i, j % SECTION_SIZE, k, block);
+  }
+
+  u_char light(int i, int j, int k) const {
+    return _light[j / SECTION_SIZE].get(i, j % SECTION_SIZE, k);
+  }
+
+  void setLight(int i, int j, int k, u_char light) {
+    _light[j / SECTION_SIZE].set(i, j % SECTION_SIZE, k, light);
+  }
+
+  bool fillRun(int i0, int i1, int j, int k, u_char block) {
+    return _sections[j / SECTION_SIZE].fillRun(i0, i1, j % SECTION_SIZE, k, block);
+  }
+
+  /// the part of box that falls in section s, in section coordinates
+  static Box sectionPart(const Box& box, int s) {
+    Box section {{0, s * SECTION_SIZE, 0}, {CHUNK_SIZE, (s + 1) * SECTION_SIZE, CHUNK_SIZE}};
+    return box.intersect(section).offset({0, -s * SECTION_SIZE, 0});
+  }
+
+  static bool coversSection(const Box& part) {
+    return part.min == glm::ivec3(0) && part.max == glm::ivec3(SECTION_SIZE);
+  }
+
+  /// set every block of box, in chunk coordinates. sections the box covers become uniform
+  /// without touching a voxel, the rest are written an x run at a time. false if box held block already
+  bool fill(const Box& box, u_char block) {
+    bool changed = false;
+    for (int s = 0; s < SECTION_COUNT; ++s) {
+      Box part = sectionPart(box, s);
+      if (part.empty()) {
+        continue;
+      }
+      Section& section = _sections[s];
+      if (coversSection(part)) {
+        if (not section.only(block)) {
+          section.fill(block);
+          changed = true;
+        }
+        continue;
+      }
+      for (int j = part.min.y; j < part.max.y; ++j)
+      for (int k = part.min.z; k < part.max.z; ++k) {
+        changed |= section.fillRun(part.min.x, part.max.x, j, k, block);
+      }
+      section.compact();
+    }
+    return changed;
+  }
+
+  /// turn every from in box into to, in chunk coordinates. uniform sections of anything else are skipped.
+  /// false if box held no from
+  bool replace(const Box& box, u_char from, u_char to) {
+    if (from == to) {
+      return false;
+    }
+    bool changed = false;
+    for (int s = 0; s < SECTION_COUNT; ++s) {
+      Box part = sectionPart(box, s);
+      Section& section = _sections[s];
+      if (part.empty() || (section.uniform() && section.uniformBlock() != from)) {
+        continue;
+      }
+      if (section.uniform() && coversSection(part)) {
+        section.fill(to);
+        changed = true;
+      } else {
+        changed |= section.replace(part, from, to);
+      }
+    }
+    return changed;
+  }
+
+  /// release storage of sections that ended up uniform
+  void compact() {
+    for (Section& section : _sections) {
+      section.compact();
+    }
+  }
+
+  /// bytes of voxel and light storage held by this column's sections
+  size_t bytes() const {
+    size_t total = 0;
+    for (int s = 0; s < SECTION_COUNT; ++s) {
+      total += _sections[s].bytes() + _light[s].bytes();
+    }
+    return total;
+  }
+
+  /// the block ids anywhere in this column, bit b for block b
+  uint32_t present() const {
+    uint32_t present = 0;
+    for (const Section& section : _sections) {
+      present |= section.present();
+    }
+    return present;
+  }
+
+  /// lowest and highest y holding anything but air, x > y when the column is empty
+  glm::ivec2 heights() const {
+    glm::ivec2 heights {CHUNK_HEIGHT, -1};
+    for (int s = 0; s < SECTION_COUNT; ++s) {
+      if (_sections[s].count(Terrain::AIR) != Section::VOLUME) {
+        heights.x = s * SECTION_SIZE + __builtin_ctz(_sections[s].layers());
+        break;
+      }
+    }
+    for (int s = SECTION_COUNT - 1; s >= 0; --s) {
+      if (_sections[s].count(Terrain::AIR) != Section::VOLUME) {
+        heights.y = s * SECTION_SIZE + 31 - __builtin_clz(_sections[s].layers());
+        break;
+      }
+    }
+    return heights;
+  }
+
+  /// opaque and liquid bits of row (j, k), bit i is block (i, j, k)
+  struct Row {
+    uint16_t opaque = 0;
+    uint16_t liquid = 0;
   };
-  State _state = State::Exists;
 
-  std::vector<Instance> _instances;
-  std::vector<Instance> _water_instances;
+  /// the opaque and liquid rows of a column and a one voxel border from its neighbours, so the mesher finds
+  /// every neighbour of a row with a shift or a fixed index and never asks where it is.
+  ///   row (j, k) is at at(j, k), with j from -1 to CHUNK_HEIGHT and k from -1 to CHUNK_SIZE, and bit i + 1 of
+  ///   a row is block i: bits 0 and 17 are the blocks at -1 and CHUNK_SIZE. the world above and below and
+  ///   columns that are not loaded are air
+  struct Padded {
+    static constexpr int WIDTH = CHUNK_SIZE + 2;
+    static constexpr uint32_t INSIDE = 0xFFFFu << 1;
 
-  /// copy cached instances
-  void load(std::vector<Instance>& instances) {
-    assert (_state >= State::Built);
-    assert (not _instances.empty());
-    instances.reserve(instances.size() + _instances.size());
-    std::copy(_instances.begin(), _instances.end(), std::back_inserter(instances));
+    std::array<uint32_t, (CHUNK_HEIGHT + 2) * WIDTH> opaque;
+    std::array<uint32_t, (CHUNK_HEIGHT + 2) * WIDTH> liquid;
+
+    static int at(int j, int k) { return (j + 1) * WIDTH + k + 1; }
+
+    /// copy the rows at height j, which may be just above or below the world
+    void fill(const Column& column, const std::array<const Edge*, 4>& neighbours, int j) {
+      if (j < 0 || j >= CHUNK_HEIGHT) {
+        std::fill_n(&opaque[at(j, -1)], WIDTH, 0);
+        std::fill_n(&liquid[at(j, -1)], WIDTH, 0);
+        return;
+      }
+      auto opaqueOf = [j](const Edge* edge) { return edge ? uint32_t(edge->opaque[j]) : 0u; };
+      auto liquidOf = [j](const Edge* edge) { return edge ? uint32_t(edge->liquid[j]) : 0u; };
+      opaque[at(j, -1)] = opaqueOf(neighbours[3]) << 1;
+      liquid[at(j, -1)] = liquidOf(neighbours[3]) << 1;
+      opaque[at(j, CHUNK_SIZE)] = opaqueOf(neighbours[1]) << 1;
+      liquid[at(j, CHUNK_SIZE)] = liquidOf(neighbours[1]) << 1;
+      // the x sides run along k, one bit of them goes on either end of each row
+      uint32_t east_opaque = opaqueOf(neighbours[0]), east_liquid = liquidOf(neighbours[0]);
+      uint32_t west_opaque = opaqueOf(neighbours[2]), west_liquid = liquidOf(neighbours[2]);
+      for (int k = 0; k < CHUNK_SIZE; ++k) {
+        Row here = column.row(j, k);
+        opaque[at(j, k)] = (west_opaque >> k & 1) | uint32_t(here.opaque) << 1 | (east_opaque >> k & 1) << 17;
+        liquid[at(j, k)] = (west_liquid >> k & 1) | uint32_t(here.liquid) << 1 | (east_liquid >> k & 1) << 17;
+      }
+    }
+  };
+
+  Row row(int j, int k) const {
+    const Section& section = _sections[j / SECTION_SIZE];
+    return {section.opaqueRow(j % SECTION_SIZE, k), section.liquidRow(j % SECTION_SIZE, k)};
   }
 
-  void load_water(std::vector<Instance>& instances) {
-    assert (_state >= State::Built);
-    instances.reserve(instances.size() + _water_instances.size());
-    std::copy(_water_instances.begin(), _water_instances.end(), std::back_inserter(instances));
+  bool isAir(int i, int j, int k) const {
+    return _sections[j / SECTION_SIZE].isAir(i, j % SECTION_SIZE, k);
   }
 
-  /// build instances for this chunk
-  void build(glm::ivec2 offset,
-    std::function<bool(int,int,int)> worldIsAir,
-    std::function<bool(int,int,int)> worldIsWater) {
-    assert (_state >= State::Generated);
-    _instances.clear();
-    _water_instances.clear();
-    auto isAir = [&](int i, int j, int k) -> bool {
-      if (i > 15 || j > 15 || k > 15 || i < 0 || j < 0 || k < 0) {
-        return worldIsAir(offset.x + i, j, offset.y + k);
+  /// the blocks on side 0 .. 3 of this column, for the meshes of the column across it
+  Edge edge(int side) const {
+    Edge edge;
+    int along_x = side % 2; // the z sides run along x
+    int at = side < 2 ? CHUNK_SIZE - 1 : 0;
+    for (int j = 0; j < CHUNK_HEIGHT; ++j) {
+      if (along_x) {
+        Row here = row(j, at);
+        edge.opaque[j] = here.opaque;
+        edge.liquid[j] = here.liquid;
+      } else {
+        for (int k = 0; k < CHUNK_SIZE; ++k) {
+          Row here = row(j, k);
+          edge.opaque[j] |= (here.opaque >> at & 1) << k;
+          edge.liquid[j] |= (here.liquid >> at & 1) << k;
+        }
       }
-      return data[i][j][k] == 0;
-    };
+      for (int t = 0; t < CHUNK_SIZE; ++t) {
+        edge.light[j * CHUNK_SIZE + t] = along_x ? light(t, j, at) : light(at, j, t);
+      }
+    }
+    return edge;
+  }
+
+  /// build instances for this column from the opaque and liquid masks, a whole row of faces at a time.
+  ///   the masks are copied into a Padded volume first, so no row needs to know where its neighbours come from
+  ///   which blocks land in which mask is up to the block registry, so new blocks need no code here
+  ///   neighbours are the edges facing this column of the columns at +x, +z, -x, -z, or nullptr if they are
+  ///   not loaded: nothing else of them is read, so their voxels need not be around.
+  ///   unloaded chunks and anything above or below the world count as air.
+  /// the faces of every block that touch something they can be seen through, as instances in chunk coordinates.
+  ///   greedy merges the faces of a section that share a direction, slice, block and light into rectangles,
+  ///   otherwise every face is an instance of its own
+  /// only the sections in the sections mask are meshed. instances always come out bottom section first and
+  /// by direction within a section, which is what lets Chunk::install swap the faces of some sections and
+  /// keep the rest, and Chunk::load leave out the directions that face away from the camera
+  void mesh(std::array<const Edge*, 4> neighbours,
+            std::vector<Instance>& instances, std::vector<Instance>& water_instances, bool greedy = GREEDY_MESHING,
+            uint32_t sections = ALL_SECTIONS) const {
+    instances.clear();
+    water_instances.clear();
+
+    // only the sections that show anything are copied, with the row just above and below each
+    thread_local Padded padded;
+    std::array<bool, SECTION_COUNT> shown;
+    for (int s = 0; s < SECTION_COUNT; ++s) {
+      shown[s] = (sections >> s & 1) && not hidden(s, neighbours);
+      for (int j = s * SECTION_SIZE - 1; shown[s] && j <= (s + 1) * SECTION_SIZE; ++j) {
+        // the row below was copied with the section below if that one shows
+        if (j >= s * SECTION_SIZE || s == 0 || not shown[s - 1]) {
+          padded.fill(*this, neighbours, j);
+        }
+      }
+    }
 
-    auto isWater = [&](int i, int j, int k) -> bool {
-      if (i > 15 || j > 15 || k > 15 || i < 0 || j < 0 || k < 0) {
-        return worldIsWater(offset.x + i, j, offset.y + k);
+    // light of the voxel (i, j, k) where that may be one block into a neighbour, or above or below the world
+    auto lightAt = [&](int i, int j, int k) -> u_char {
+      if (j >= CHUNK_HEIGHT) {
+        return Light::SKY;
       }
-      return data[i][j][k] == Terrain::WATER;
+      if (j < 0) {
+        return 0;
+      }
+      const Edge* edge;
+      int t;
+      if (i < 0)                { edge = neighbours[2]; t = k; }
+      else if (i >= CHUNK_SIZE) { edge = neighbours[0]; t = k; }
+      else if (k < 0)           { edge = neighbours[3]; t = i; }
+      else if (k >= CHUNK_SIZE) { edge = neighbours[1]; t = i; }
+      else                      { return light(i, j, k); }
+      return edge ? edge->light[j * CHUNK_SIZE + t] : Light::SKY;
     };
 
-    auto addCube = [&](glm::vec3 pos, const std::array<bool, 6>& transparences, 
-      GLuint texture_index, std::vector<Instance>& buff) {
+    // a step in each direction 0 .. 5
+    static constexpr int STEP[6][3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}, {-1, 0, 0}, {0, -1, 0}, {0, 0, -1}};
+
+    // greedy: the faces of a section go into a grid per kind (opaque, liquid), direction and slice along the
+    // normal first, as block | light << 8 or 0 for no face, laid out [v][u] over the two axes of the face.
+    // merging takes every face back out, so the grids are all zero again for the next section
+    using Slice = std::array<uint16_t, SECTION_SIZE * SECTION_SIZE>;
+    thread_local std::array<std::array<std::array<Slice, SECTION_SIZE>, 6>, 2> grids;
+    // otherwise a section's faces wait per kind and direction, and go out in direction order once it is done
+    thread_local std::array<std::array<std::vector<Instance>, 6>, 2> buckets;
 
-      for (int i = 0; i < 6; ++i) {
-        if (transparences[i]) {
-          buff.emplace_back(pos, i, texture_index);
+    auto emit = [&](uint16_t faces, int direction, int j, int k, std::vector<Instance>& buff) {
+      const int* step = STEP[direction];
+      while (faces) {
+        int i = __builtin_ctz(faces);
+        faces &= faces - 1;
+        u_char light = lightAt(i + step[0], j + step[1], k + step[2]);
+        if (greedy) {
+          int local[3] = {i, j % SECTION_SIZE, k};
+          int n = direction % 3;
+          int u = local[(n + 1) % 3], v = local[(n + 2) % 3];
+          grids[&buff == &water_instances][direction][local[n]][v * SECTION_SIZE + u] = get(i, j, k) | light << 8;
+        } else {
+          buckets[&buff == &water_instances][direction].emplace_back(glm::ivec3(i, j, k), direction, get(i, j, k), light);
         }
       }
     };
 
-    for (int i = 0; i < CHUNK_SIZE; ++i)
-    for (int j = 0; j < CHUNK_HEIGHT; ++j)
-    for (int k = 0; k < CHUNK_SIZE; ++k) 
+    // grow a rectangle from every face left in a slice: as wide along u as the face repeats, then as high
+    // along v as whole rows of that width repeat
+    auto merge = [&](int s, std::vector<Instance>& buff, int kind) {
+      for (int direction = 0; direction < 6; ++direction)
+      for (int slice = 0; slice < SECTION_SIZE; ++slice) {
+        Slice& grid = grids[kind][direction][slice];
+        int n = direction % 3;
+        for (int v = 0; v < SECTION_SIZE; ++v)
+        for (int u = 0; u < SECTION_SIZE; ++u) {
+          uint16_t key = grid[v * SECTION_SIZE + u];
+          if (key == 0) {
+            continue;
+          }
+          int width = 1;
+          while (u + width < SECTION_SIZE && grid[v * SECTION_SIZE + u + width] == key) {
+            ++width;
+          }
+          int height = 1;
+          while (v + height < SECTION_SIZE && std::all_of(&grid[(v + height) * SECTION_SIZE + u],
+                                                         &grid[(v + height) * SECTION_SIZE + u + width],
+                                                         [key](uint16_t other) { return other == key; })) {
+            ++height;
+          }
+          for (int dv = 0; dv < height; ++dv) {
+            std::fill_n(&grid[(v + dv) * SECTION_SIZE + u], width, 0);
+          }
+          int local[3];
+          local[n] = slice;
+          local[(n + 1) % 3] = u;
+          local[(n + 2) % 3] = v;
+          buff.emplace_back(glm::ivec3(local[0], local[1] + s * SECTION_SIZE, local[2]),
+                            direction, key & 0xFF, key >> 8, width, height);
+        }
+      }
+    };
+
+    for (int s = 0; s < SECTION_COUNT; ++s) {
+    if (not shown[s]) {
+      continue;
+    }
+
+    for (int j = s * SECTION_SIZE; j < (s + 1) * SECTION_SIZE; ++j)
+    for (int k = 0; k < CHUNK_SIZE; ++k)
     {
-      const unsigned char& block = data[i][j][k];
-      if (block != 0 && block != Terrain::WATER) {
-        std::array<bool, 6> airs = {
-          isAir(i+1, j,   k)  ,
-          isAir(i,   j+1, k)  ,
-          isAir(i,   j,   k+1),
-          isAir(i-1, j,   k)  ,
-          isAir(i,   j-1, k)  ,
-          isAir(i,   j,   k-1),
-        };
-        std::array<bool, 6> waters = {
-          isWater(i+1, j,   k)  ,
-          isWater(i,   j+1, k)  ,
-          isWater(i,   j,   k+1),
-          isWater(i-1, j,   k)  ,
-          isWater(i,   j-1, k)  ,
-          isWater(i,   j,   k-1),
-        };
-
-        addCube({i + offset.x, j, k + offset.y}, airs, data[i][j][k], _instances);
-        addCube({i + offset.x, j, k + offset.y}, waters, data[i][j][k], _instances);
-      } else if (block == Terrain::WATER) {
-        std::array<bool, 6> airs = {
-          isAir(i+1, j,   k)  ,
-          isAir(i,   j+1, k)  ,
-          isAir(i,   j,   k+1),
-          isAir(i-1, j,   k)  ,
-          isAir(i,   j-1, k)  ,
-          isAir(i,   j,   k-1),
-        };
-
-        addCube({i + offset.x, j, k + offset.y}, airs, data[i][j][k], _water_instances);
+      int at = Padded::at(j, k);
+      uint32_t opaque = padded.opaque[at];
+      uint32_t liquid = padded.liquid[at];
+      if (((opaque | liquid) & Padded::INSIDE) == 0) {
+        continue;
+      }
+
+      // per direction 0 .. 5 = x, y, z, -x, -y, -z: the neighbours of every voxel of this row, lined up with it
+      const uint32_t next_opaque[6] = {
+        opaque >> 1, padded.opaque[at + Padded::WIDTH], padded.opaque[at + 1],
+        opaque << 1, padded.opaque[at - Padded::WIDTH], padded.opaque[at - 1],
+      };
+      const uint32_t next_liquid[6] = {
+        liquid >> 1, padded.liquid[at + Padded::WIDTH], padded.liquid[at + 1],
+        liquid << 1, padded.liquid[at - Padded::WIDTH], padded.liquid[at - 1],
+      };
+
+      for (int d = 0; d < 6; ++d) {
+        // opaque faces show against anything see-through, liquids only against air
+        emit(uint16_t((opaque & ~next_opaque[d]) >> 1),                  d, j, k, instances);
+        emit(uint16_t((liquid & ~(next_opaque[d] | next_liquid[d])) >> 1), d, j, k, water_instances);
       }
     }
 
+    if (greedy) {
+      merge(s, instances, 0);
+      merge(s, water_instances, 1);
+    } else {
+      for (int kind = 0; kind < 2; ++kind)
+      for (std::vector<Instance>& bucket : buckets[kind]) {
+        std::vector<Instance>& buff = kind ? water_instances : instances;
+        buff.insert(buff.end(), bucket.begin(), bucket.end());
+        bucket.clear();
+      }
+    }
+    }
+  }
+
+  /// a section emits no faces if it is all air, or if it is uniform and nothing around it exposes it: the
+  /// sections above and below are uniform and the neighbours' edges are covered all along the section.
+  /// opaque needs opaque around it, liquid needs opaque or liquid. out of the world and unloaded chunks
+  /// count as air, like World::isAir.
+  bool hidden(int s, const std::array<const Edge*, 4>& neighbours) const {
+    const Section& section = _sections[s];
+    if (not section.uniform()) {
+      return false;
+    }
+    u_char block = section.uniformBlock();
+    if (block == Terrain::AIR) {
+      return true;
+    }
+
+    auto covers = [block](const Section* other) {
+      if (other == nullptr || not other->uniform()) {
+        return false;
+      }
+      u_char b = other->uniformBlock();
+      return Section::isOpaque(b) || (Section::isLiquid(block) && Section::isLiquid(b));
+    };
+
+    if (not covers(s + 1 < SECTION_COUNT ? &_sections[s + 1] : nullptr)
+        || not covers(s > 0 ? &_sections[s - 1] : nullptr)) {
+      return false;
+    }
+    for (const Edge* edge : neighbours) {
+      for (int j = s * SECTION_SIZE; j < (s + 1) * SECTION_SIZE; ++j) {
+        uint16_t cover = edge ? edge->opaque[j] | (Section::isLiquid(block) ? edge->liquid[j] : 0) : 0;
+        if (cover != 0xFFFF) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+};
+
+/// instances meshed from a MeshJob, tagged with the versions they were meshed from
+struct MeshResult {
+  glm::ivec2 chunk_index;
+  std::array<uint64_t, 5> versions {};
+  uint32_t sections = Column::ALL_SECTIONS; // the sections these instances replace
+  std::array<std::shared_ptr<const Edge>, 4> edges; // the neighbours' edges they were meshed against
+  std::array<uint16_t, SECTION_COUNT> visibility; // Visibility::graph of each of those sections
+  Mesh instances;
+  Mesh water_instances;
+};
+
+/// a chunk and the edges of its four neighbours as they were when the job was made.
+/// the sections are shared copy-on-write and edges are never written once published, so a job can be
+/// meshed on any thread while the main thread keeps editing: an edit swaps in a copy of the section and
+/// leaves the job's alone.
+struct MeshJob {
+  glm::ivec2 chunk_index;
+  std::array<uint64_t, 5> versions {}; // the chunk, then the edges of +x, +z, -x, -z; 0 for a missing neighbour
+  Column column;
+  std::array<std::shared_ptr<const Edge>, 4> neighbours; // each one's edge facing this chunk, or nullptr
+  bool greedy = GREEDY_MESHING;
+  uint32_t sections = Column::ALL_SECTIONS; // mesh only these, for a chunk that is built already
+
+  MeshResult run() const {
+    // mesh into per-thread scratch that keeps its capacity, then store into pooled meshes
+    thread_local std::vector<Instance> instances;
+    thread_local std::vector<Instance> water_instances;
+
+    std::array<const Edge*, 4> loaded;
+    for (int n = 0; n < 4; ++n) {
+      loaded[n] = neighbours[n].get();
+    }
+    column.mesh(loaded, instances, water_instances, greedy, sections);
+
+    MeshResult result {chunk_index, versions, sections, neighbours};
+    for (int s = 0; s < SECTION_COUNT; ++s) {
+      result.visibility[s] = sections >> s & 1 ? Visibility::graph(column._sections[s]) : Visibility::ALL;
+    }
+    store(result.instances, instances);
+    store(result.water_instances, water_instances);
+    return result;
+  }
+
+  /// copy into a mesh whose capacity fills its whole size class, so small regrowth on rebuild is free
+  static void store(Mesh& mesh, const std::vector<Instance>& instances) {
+    if (instances.size() > mesh.capacity()) {
+      size_t bytes = SizeClassPool::classBytes(SizeClassPool::sizeClass(instances.size() * sizeof(Instance)));
+      Mesh fresh;
+      fresh.reserve(bytes / sizeof(Instance));
+      mesh.swap(fresh);
+    }
+    mesh.assign(instances.begin(), instances.end());
+  }
+};
+
+/// the meshes of a chunk at a level of detail, see Lod.h
+struct LodMesh {
+  std::array<uint64_t, 5> versions {}; // what they were meshed from, like MeshResult; all 0 before the first time
+  Mesh instances;                      // level 0 draws the chunk's own meshes and leaves these empty
+  Mesh water_instances;
+  std::array<Mesh, 4> skirts;          // per side +x, +z, -x, -z, for a neighbour drawn at another level
+
+  bool meshed() const { return versions[0] != 0; }
+};
+
+/// the top of the summary pyramid: sections count their blocks, columns roll those up on demand,
+/// and World keeps one of these per SUMMARY_REGION_CHUNKS^2 chunks, rebuilt lazily after a write
+struct RegionSummary {
+  uint32_t present = 0;   // block ids anywhere in the region's loaded chunks
+  int low = CHUNK_HEIGHT; // lowest and highest y of anything but air
+  int high = -1;
+  bool stale = true;      // a chunk in the region was written, loaded or evicted since the last rebuild
+};
+
+struct Chunk : Column {
+  enum class State {                                    /* Generated_Trees == Generated */
+    Exists = 0, Generated_Ground = 1, Generated_Caves = 2, Generated_Trees = 3, Generated = 3, Built = 4
+  };
+  State _state = State::Exists;
+
+  /// the chunks around this one, or nullptr where none is loaded. World links them on create and unlinks on evict
+  static constexpr std::array<glm::ivec2, 8> NEIGHBOURS {{
+    {1, 0}, {0, 1}, {-1, 0}, {0, -1},   // the four a mesh reads faces from, in MeshJob order
+    {1, 1}, {-1, 1}, {-1, -1}, {1, -1},
+  }};
+  std::array<Chunk*, 8> _neighbours {};
+  int _generated_neighbours = 0; // how many of _neighbours are loaded and at least Generated
+  RegionSummary* _region = nullptr; // the World summary this chunk is part of, once linked
+
+  bool _modified = false;  // written after generation, so it has to be saved before it can be evicted
+  uint64_t _last_used = 0; // World::_tick when this chunk was last in the active set
+  size_t _counted = 0;     // residentBytes() as World::_resident last counted it
+  uint64_t _version = nextVersion(); // changes with every write, meshes of older versions are stale
+
+  Mesh _instances;
+  Mesh _water_instances;
+  uint32_t _dirty = 0; // sections of a built chunk whose faces changed since it was meshed, see World::remesh
+  std::array<std::shared_ptr<const Edge>, 4> _meshed_against; // the neighbours' edges the instances show
+  std::array<uint16_t, SECTION_COUNT> _visibility; // Visibility::graph of every section as it was meshed
+  int _lod = 0;                          // the level of detail it should be drawn at, see World::remesh
+  std::array<LodMesh, LOD_LEVELS> _lods; // the meshes of each level, once they were needed
+
+  /// the sides of this chunk as its neighbours mesh against them. taken again when the chunk's version moved
+  /// on, but published with a new version only if the side actually changed, so a write anywhere
+  /// else in the chunk leaves the neighbours' meshes alone. main thread only, like writes
+  mutable std::array<std::shared_ptr<const Edge>, 4> _edges;
+  mutable std::array<uint64_t, 4> _edge_versions {};
+  mutable std::array<uint64_t, 4> _edges_taken {}; // the _version each edge was last compared at
+
+  /// versions are unique across chunks, so a chunk evicted and created again never repeats one.
+  ///   only the main thread creates and writes chunks
+  static uint64_t nextVersion() {
+    static uint64_t clock = 0;
+    return ++clock;
+  }
+
+  void set(int i, int j, int k, u_char block) {
+    if (get(i, j, k) != block) {
+      Column::set(i, j, k, block);
+      touch();
+    }
+  }
+
+  /// after any write: meshes of the old version are stale and so is the region summary
+  void touch() {
+    _version = nextVersion();
+    if (_region) {
+      _region->stale = true;
+    }
+  }
+
+  /// every state change goes through here, so the neighbours' counts follow
+  void setState(State state) {
+    bool was_generated = _state >= State::Generated;
+    bool generated = state >= State::Generated;
+    _state = state;
+    if (was_generated != generated) {
+      for (Chunk* neighbour : _neighbours) {
+        if (neighbour) {
+          neighbour->_generated_neighbours += generated ? 1 : -1;
+        }
+      }
+    }
+  }
+
+  const std::shared_ptr<const Edge>& edge(int side) const {
+    if (_edges_taken[side] != _version) {
+      _edges_taken[side] = _version;
+      Edge now = Column::edge(side);
+      if (not _edges[side] || _edges[side]->differ(now)) {
+        _edges[side] = std::make_shared<const Edge>(now);
+        _edge_versions[side] = nextVersion();
+      }
+    }
+    return _edges[side];
+  }
+
+  uint64_t edgeVersion(int side) const {
+    edge(side);
+    return _edge_versions[side];
+  }
+
+  /// the level whose meshes are drawn: _lod, or full detail until that level has been meshed once
+  int drawnLevel() const {
+    return _lod > 0 && _lods[_lod].meshed() ? _lod : 0;
+  }
+
+  /// this chunk and all 8 around it are generated, so it can be meshed
+  bool surroundingsGenerated() const {
+    return _state >= State::Generated && _generated_neighbours == 8;
+  }
+
+  /// everything this chunk keeps resident: itself, its sections, its edges and its cached instances of every level
+  size_t residentBytes() const {
+    size_t edges = 0;
+    for (const auto& edge : _edges) {
+      edges += edge ? sizeof(Edge) : 0;
+    }
+    size_t instances = _instances.capacity() + _water_instances.capacity();
+    for (const LodMesh& lod : _lods) {
+      instances += lod.instances.capacity() + lod.water_instances.capacity();
+      for (const Mesh& skirt : lod.skirts) {
+        instances += skirt.capacity();
+      }
+    }
+    return sizeof(Chunk) + bytes() + edges + instances * sizeof(Instance);
+  }
+
+  /// take ground generated off-thread into a column of its own.
+  ///   anything written here in the meantime wins over generated air
+  void installGround(Column&& generated) {
+    assert (_state == State::Exists);
+    for (int s = 0; s < SECTION_COUNT; ++s) {
+      Section& live = _sections[s];
+      Section& fresh = generated._sections[s];
+      if (not live.uniform() || live.uniformBlock() != Terrain::AIR) {
+        for (int i = 0; i < SECTION_SIZE; ++i)
+        for (int j = 0; j < SECTION_SIZE; ++j)
+        for (int k = 0; k < SECTION_SIZE; ++k) {
+          if (fresh.get(i, j, k) == Terrain::AIR) {
+            fresh.set(i, j, k, live.get(i, j, k));
+          }
+        }
+        fresh.compact();
+      }
+      live = std::move(fresh);
+    }
+    touch();
+    setState(State::Generated_Ground);
+  }
+
+  /// take meshed instances, handing the old buffers back with the result. a result of some sections only
+  /// replaces those sections' instances in a chunk that is built
+  void install(MeshResult& result) {
+    assert (_state >= State::Generated);
+    if (result.sections == ALL_SECTIONS) {
+      _instances.swap(result.instances);
+      _water_instances.swap(result.water_instances);
+      _dirty = 0;
+    } else {
+      assert (_state == State::Built);
+      splice(_instances, result.instances, result.sections);
+      splice(_water_instances, result.water_instances, result.sections);
+      _dirty &= ~result.sections;
+    }
+    _meshed_against = result.edges;
+    for (int s = 0; s < SECTION_COUNT; ++s) {
+      if (result.sections >> s & 1) {
+        _visibility[s] = result.visibility[s];
+      }
+    }
+    setState(State::Built);
+  }
+
+  /// put the instances of sections from fresh in place of the ones mesh has for them. both hold their
+  /// instances bottom section first
+  static void splice(Mesh& mesh, const Mesh& fresh, uint32_t sections) {
+    thread_local std::vector<Instance> spliced;
+    spliced.clear();
+    auto old_it = mesh.begin();
+    auto fresh_it = fresh.begin();
+    for (int s = 0; s < SECTION_COUNT; ++s) {
+      auto below = [s](const Instance& face) { return face.y() < (s + 1) * SECTION_SIZE; };
+      auto old_end = std::partition_point(old_it, mesh.end(), below);
+      auto fresh_end = std::partition_point(fresh_it, fresh.end(), below);
+      if (sections >> s & 1) {
+        spliced.insert(spliced.end(), fresh_it, fresh_end);
+      } else {
+        spliced.insert(spliced.end(), old_it, old_end);
+      }
+      old_it = old_end;
+      fresh_it = fresh_end;
+    }
+    MeshJob::store(mesh, spliced);
+  }
+
+  /// the directions to copy of each section, bit d for direction d, see Visibility::facing
+  using Directions = std::array<uint8_t, SECTION_COUNT>;
+  static Directions allDirections() {
+    Directions all;
+    all.fill(Visibility::ALL_DIRECTIONS);
+    return all;
+  }
+
+  /// copy cached instances of the given sections at the level drawn, and of those only the given directions
+  void load(std::vector<Instance>& instances, uint32_t sections = ALL_SECTIONS,
+            const Directions& directions = allDirections()) const {
+    assert (_state >= State::Built);
     assert (not _instances.empty());
-    _state = State::Built;
+    int level = drawnLevel();
+    copySections(level ? _lods[level].instances : _instances, instances, sections, directions);
+  }
+
+  void load_water(std::vector<Instance>& instances, uint32_t sections = ALL_SECTIONS,
+                  const Directions& directions = allDirections()) const {
+    assert (_state >= State::Built);
+    int level = drawnLevel();
+    copySections(level ? _lods[level].water_instances : _water_instances, instances, sections, directions);
+  }
+
+  static void copySections(const Mesh& mesh, std::vector<Instance>& instances, uint32_t sections,
+                           const Directions& directions) {
+    auto it = mesh.begin();
+    for (int s = 0; s < SECTION_COUNT && it != mesh.end(); ++s) {
+      auto end = std::partition_point(it, mesh.end(), [s](const Instance& face) { return face.y() < (s + 1) * SECTION_SIZE; });
+      if (not (sections >> s & 1)) {
+        it = end;
+        continue;
+      }
+      if (directions[s] == Visibility::ALL_DIRECTIONS) {
+        instances.insert(instances.end(), it, end);
+        it = end;
+        continue;
+      }
+      // a section's instances are in direction order: one contiguous run per direction
+      for (GLuint d = 0; d < 6; ++d) {
+        auto run_end = std::partition_point(it, end, [d](const Instance& face) { return face.direction() <= d; });
+        if (directions[s] >> d & 1) {
+          instances.insert(instances.end(), it, run_end);
+        }
+        it = run_end;
+      }
+    }
   }
-};
\ No newline at end of file
+};
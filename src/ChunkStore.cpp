@@ -0,0 +1,140 @@
+#include "ChunkStore.h"
+#include "Chunk.h"
+
+#include <filesystem>
+#include <fstream>
+
+std::string ChunkStore::directory = "saves";
+
+// file layout: "CHNK", height, then per section either
+//   0, block          a uniform section
+//   1, 4096 blocks    a section with its own storage, in Layout::Linear order whatever VoxelLayout is
+// then the number of pending block updates and each as position in the chunk, kind, ticks left.
+// files from before there were block updates end after the sections
+static constexpr char MAGIC[4] = {'C', 'H', 'N', 'K'};
+
+// a block byte the registry has no row for can only come from a damaged file
+static bool known(int block) {
+  return block < Terrain::BLOCK_COUNT;
+}
+
+// blocks between VoxelLayout and the Linear order on disk
+static void toLinear(const Section::Blocks& blocks, Section::Blocks& linear) {
+  for (int i = 0; i < SECTION_SIZE; ++i)
+  for (int j = 0; j < SECTION_SIZE; ++j)
+  for (int k = 0; k < SECTION_SIZE; ++k) {
+    linear[Layout::Linear::index(i, j, k)] = blocks[Section::index(i, j, k)];
+  }
+}
+
+static void fromLinear(const Section::Blocks& linear, Section::Blocks& blocks) {
+  for (int i = 0; i < SECTION_SIZE; ++i)
+  for (int j = 0; j < SECTION_SIZE; ++j)
+  for (int k = 0; k < SECTION_SIZE; ++k) {
+    blocks[Section::index(i, j, k)] = linear[Layout::Linear::index(i, j, k)];
+  }
+}
+
+static std::string path(glm::ivec2 chunk_index) {
+  return ChunkStore::directory + "/" + std::to_string(chunk_index.x) + "." + std::to_string(chunk_index.y) + ".chunk";
+}
+
+bool ChunkStore::save(const Chunk& chunk, glm::ivec2 chunk_index, const std::vector<Scheduler::Suspended>& updates) {
+  std::error_code error;
+  std::filesystem::create_directories(directory, error);
+  std::ofstream out {path(chunk_index), std::ios::binary | std::ios::trunc};
+  if (not out) {
+    return false;
+  }
+
+  int height = CHUNK_HEIGHT;
+  out.write(MAGIC, sizeof(MAGIC));
+  out.write(reinterpret_cast<const char*>(&height), sizeof(height));
+
+  for (const Section& section : chunk._sections) {
+    if (section.uniform()) {
+      u_char header[2] = {0, section.uniformBlock()};
+      out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    } else {
+      out.put(1);
+      Section::Blocks linear;
+      toLinear(section._data->blocks, linear);
+      out.write(reinterpret_cast<const char*>(linear.data()), sizeof(linear));
+    }
+  }
+
+  uint32_t count = updates.size();
+  out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+  for (const Scheduler::Suspended& update : updates) {
+    out.write(reinterpret_cast<const char*>(&update.local), sizeof(update.local));
+    out.put(update.kind);
+    out.write(reinterpret_cast<const char*>(&update.delay), sizeof(update.delay));
+  }
+  out.flush();
+  return out.good();
+}
+
+bool ChunkStore::load(Chunk& chunk, glm::ivec2 chunk_index, std::vector<Scheduler::Suspended>& updates) {
+  std::ifstream in {path(chunk_index), std::ios::binary};
+  if (not in) {
+    return false;
+  }
+
+  char magic[4];
+  int height = 0;
+  in.read(magic, sizeof(magic));
+  in.read(reinterpret_cast<char*>(&height), sizeof(height));
+  if (not in || not std::equal(magic, magic + 4, MAGIC) || height != CHUNK_HEIGHT) {
+    return false;
+  }
+
+  // into sections of our own first, so a file cut short or corrupt leaves the chunk alone
+  std::array<Section, SECTION_COUNT> sections;
+  for (Section& section : sections) {
+    int kind = in.get();
+    if (kind == 0) {
+      int block = in.get();
+      if (not in || not known(block)) {
+        return false;
+      }
+      section.fill(block);
+    } else if (kind == 1) {
+      Section::Blocks linear, blocks;
+      in.read(reinterpret_cast<char*>(linear.data()), sizeof(linear));
+      if (not in || not std::all_of(linear.begin(), linear.end(), known)) {
+        return false;
+      }
+      fromLinear(linear, blocks);
+      section.assign(blocks);
+    } else {
+      return false;
+    }
+  }
+
+  std::vector<Scheduler::Suspended> pending;
+  uint32_t count = 0;
+  if (in.read(reinterpret_cast<char*>(&count), sizeof(count))) {
+    // at most one update per block, more can only come from a damaged file
+    if (count > uint32_t(CHUNK_SIZE * CHUNK_HEIGHT * CHUNK_SIZE)) {
+      return false;
+    }
+    pending.resize(count);
+    for (Scheduler::Suspended& update : pending) {
+      in.read(reinterpret_cast<char*>(&update.local), sizeof(update.local));
+      update.kind = in.get();
+      in.read(reinterpret_cast<char*>(&update.delay), sizeof(update.delay));
+      if (not in || update.local >= uint32_t(CHUNK_SIZE * CHUNK_HEIGHT * CHUNK_SIZE)
+          || update.kind >= BlockUpdate::KIND_COUNT || update.delay == 0) {
+        return false;
+      }
+    }
+  }
+
+  for (int s = 0; s < SECTION_COUNT; ++s) {
+    chunk._sections[s] = std::move(sections[s]);
+  }
+  updates = std::move(pending);
+
+  chunk.setState(Chunk::State::Generated);
+  return true;
+}
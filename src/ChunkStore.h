@@ -0,0 +1,23 @@
+#pragma once
+
+#include "Scheduler.h"
+
+#include <glm/vec2.hpp>
+
+#include <string>
+#include <vector>
+
+struct Chunk;
+
+/// on-disk copies of chunks that were modified after generation or have block updates pending,
+/// one file per chunk
+namespace ChunkStore {
+  extern std::string directory;
+
+  /// returns false if the file could not be written whole, and then the chunk and its updates must stay in memory
+  bool save(const Chunk& chunk, glm::ivec2 chunk_index, const std::vector<Scheduler::Suspended>& updates);
+
+  /// fills an empty chunk and its pending updates from disk, returns false if the chunk was never saved.
+  /// a file that is not a whole chunk reads as never saved and leaves the chunk as it was
+  bool load(Chunk& chunk, glm::ivec2 chunk_index, std::vector<Scheduler::Suspended>& updates);
+}
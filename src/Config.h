@@ -1,6 +1,71 @@
 #pragma once
 
+#include <cstddef>
+
+// world height is picked at configure time: cmake -DWORLD_HEIGHT=256 (or 384)
+#ifndef WORLD_HEIGHT
+#define WORLD_HEIGHT 128
+#endif
+
 constexpr int CHUNK_SIZE = 16;
-constexpr int CHUNK_HEIGHT = 128;
+constexpr int CHUNK_HEIGHT = WORLD_HEIGHT;
+constexpr int SECTION_SIZE = 16;
+constexpr int SECTION_COUNT = CHUNK_HEIGHT / SECTION_SIZE;
 constexpr int GEN_DISTANCE = 10;
-constexpr int RENDER_DISTANCE = 7;
\ No newline at end of file
+constexpr int RENDER_DISTANCE = 7;
+
+// chunks further than this from the player may be evicted, least recently used first,
+// whenever everything resident is over the memory budget
+constexpr int RETENTION_DISTANCE = RENDER_DISTANCE + 4;
+constexpr size_t CHUNK_MEMORY_BUDGET = 256 * 1024 * 1024;
+
+// merge coplanar faces that look the same into one quad per rectangle, instead of an instance per face
+constexpr bool GREEDY_MESHING = true;
+
+// draw only the sections a search from the camera reaches through open cells, see Visibility.h
+constexpr bool CAVE_CULLING = true;
+
+// send only the directions of a section's faces that can face the camera, the rest the GPU would cull anyway
+constexpr bool BACK_FACE_CULLING = true;
+
+// meshing runs on worker threads, with at most this many chunks handed out and not installed yet
+constexpr int MESH_JOBS_IN_FLIGHT = 32;
+
+// chunks more than LOD_DISTANCES[l] chunks from the player are drawn from their blocks downsampled 2^(l+1)
+// times, see Lod.h. coming closer, a chunk goes back to the finer level LOD_HYSTERESIS chunks past the line,
+// and at most LOD_MESHES_PER_FRAME meshes of other levels are made a frame
+constexpr bool MESH_LOD = true;
+constexpr int LOD_LEVELS = 3;
+constexpr int LOD_DISTANCES[LOD_LEVELS - 1] = {3, 5};
+constexpr int LOD_HYSTERESIS = 1;
+constexpr int LOD_MESHES_PER_FRAME = 4;
+
+// spatial queries keep a summary per square of this many chunks on a side
+constexpr int SUMMARY_REGION_CHUNKS = 8;
+
+// the far field keeps every explored chunk at one cell per FAR_FIELD_SCALE^3 blocks
+constexpr int FAR_FIELD_SCALE = 4;
+
+// flowing water moves one block every WATER_TICK seconds, and a tick looks at no more than
+// WATER_TICK_BUDGET cells. cells over the budget wait for the next tick
+constexpr double WATER_TICK = 0.25;
+constexpr int WATER_TICK_BUDGET = 8192;
+
+// scheduled block updates and random ticks run every BLOCK_TICK seconds. every section around the player
+// with a block that reacts to random ticks gets RANDOM_TICKS_PER_SECTION random voxels looked at each tick
+constexpr double BLOCK_TICK = 0.05;
+constexpr int RANDOM_TICKS_PER_SECTION = 3;
+
+// leaves stay as long as a trunk is at most this many steps away through leaves. the widest generated
+// canopy layer is a square 6 blocks out from the trunk, so its corners are 12 steps away
+constexpr int LEAF_REACH = 12;
+
+// back the 2 MB section slabs with transparent huge pages
+constexpr bool POOL_HUGE_PAGES = true;
+
+static_assert(CHUNK_HEIGHT % SECTION_SIZE == 0, "world height must be a whole number of sections");
+static_assert(CHUNK_HEIGHT <= 384, "world height is at most 384");
+static_assert(RETENTION_DISTANCE > RENDER_DISTANCE, "building a chunk needs its neighbours resident");
+static_assert(LOD_LEVELS <= 3, "a cell of the coarsest level is at most 4 blocks on a side");
+static_assert(FAR_FIELD_SCALE == 1 || FAR_FIELD_SCALE == 2 || FAR_FIELD_SCALE == 4 || FAR_FIELD_SCALE == 8,
+              "a far field cell is a power of two that divides a section");
@@ -0,0 +1,159 @@
+#include "FarField.h"
+#include "Chunk.h"
+
+#include <cassert>
+
+void FarField::update(glm::ivec2 chunk_index, const Column& column) {
+  constexpr int SCALE = FAR_FIELD_SCALE;
+  std::array<u_char, CELLS * CELLS * CELLS> cells;
+  std::array<u_char, SCALE * SCALE * SCALE> blocks;
+
+  Roots roots;
+  for (int s = 0; s < SECTION_COUNT; ++s) {
+    const Section& section = column._sections[s];
+    if (section.uniform()) {
+      roots[s] = section.uniformBlock();
+      continue;
+    }
+
+    for (int cx = 0; cx < CELLS; ++cx)
+    for (int cy = 0; cy < CELLS; ++cy)
+    for (int cz = 0; cz < CELLS; ++cz) {
+      int n = 0;
+      for (int i = 0; i < SCALE; ++i)
+      for (int j = 0; j < SCALE; ++j)
+      for (int k = 0; k < SCALE; ++k) {
+        blocks[n++] = section.get(cx * SCALE + i, cy * SCALE + j, cz * SCALE + k);
+      }
+      cells[(cx * CELLS + cy) * CELLS + cz] = represent(blocks.data(), n);
+    }
+    roots[s] = build(cells.data(), 0, 0, 0, CELLS);
+  }
+
+  _chunks[chunk_index] = _column_index.intern(_columns, roots);
+
+  // replaced copies leave garbage behind, collect once it matches what is live
+  if (_nodes.size() + _columns.size() > 2 * _live_after_collect + 4096) {
+    collect();
+  }
+}
+
+FarField::Ref FarField::build(const u_char* cells, int x, int y, int z, int size) {
+  if (size == 1) {
+    return cells[(x * CELLS + y) * CELLS + z];
+  }
+
+  int half = size / 2;
+  Node node;
+  std::array<u_char, 8> looks;
+  for (int o = 0; o < 8; ++o) {
+    Ref child = build(cells, x + (o & 1) * half, y + ((o >> 1) & 1) * half, z + ((o >> 2) & 1) * half, half);
+    node.children[o] = child;
+    looks[o] = child < FIRST_NODE ? child : _nodes[child - FIRST_NODE].block;
+  }
+
+  // eight of the same block is that block
+  if (node.children[0] < FIRST_NODE
+      && std::all_of(node.children.begin(), node.children.end(), [&](Ref c) { return c == node.children[0]; })) {
+    return node.children[0];
+  }
+
+  node.block = represent(looks.data(), looks.size());
+  return FIRST_NODE + _node_index.intern(_nodes, node);
+}
+
+/// from afar a cell is air unless at least half of it is not, then it is its most common block
+u_char FarField::represent(const u_char* blocks, int count) {
+  std::array<uint16_t, 256> counts {};
+  int filled = 0;
+  for (int n = 0; n < count; ++n) {
+    counts[blocks[n]]++;
+    filled += blocks[n] != Terrain::AIR;
+  }
+  if (filled * 2 < count) {
+    return Terrain::AIR;
+  }
+  counts[Terrain::AIR] = 0;
+  return std::max_element(counts.begin(), counts.end()) - counts.begin();
+}
+
+u_char FarField::sample(glm::ivec2 chunk_index, glm::ivec3 cell, int level) const {
+  assert (level >= 0 && level <= LEVELS);
+  const Roots& roots = _columns[_chunks.at(chunk_index)];
+
+  // walk down from the section root in level 0 cells until a node is as big as the cell asked for
+  int cell_size = 1 << level;
+  glm::ivec3 pos = cell * cell_size;
+  int s = pos.y / CELLS;
+  pos.y -= s * CELLS;
+
+  Ref ref = roots[s];
+  for (int size = CELLS; ref >= FIRST_NODE && size > cell_size; size /= 2) {
+    int half = size / 2;
+    glm::ivec3 octant {pos.x >= half, pos.y >= half, pos.z >= half};
+    pos -= octant * half;
+    ref = _nodes[ref - FIRST_NODE].children[octant.x + 2 * octant.y + 4 * octant.z];
+  }
+  return ref < FIRST_NODE ? ref : _nodes[ref - FIRST_NODE].block;
+}
+
+void FarField::extract(glm::ivec2 chunk_index, int level, std::vector<u_char>& cells) const {
+  int width = CHUNK_CELLS >> level;
+  int height = HEIGHT_CELLS >> level;
+  cells.resize(width * height * width);
+  for (int x = 0; x < width; ++x)
+  for (int y = 0; y < height; ++y)
+  for (int z = 0; z < width; ++z) {
+    cells[(x * height + y) * width + z] = sample(chunk_index, {x, y, z}, level);
+  }
+}
+
+void FarField::collect() {
+  std::vector<Node> nodes;
+  std::vector<Roots> columns;
+  std::vector<Ref> node_remap(_nodes.size(), 0);
+  std::vector<uint32_t> column_remap(_columns.size(), UINT32_MAX);
+
+  // children are kept before their parents, so the new vector stays in build order
+  auto keep = [&](Ref ref, auto& self) -> Ref {
+    if (ref < FIRST_NODE) {
+      return ref;
+    }
+    Ref& remapped = node_remap[ref - FIRST_NODE];
+    if (remapped == 0) {
+      Node node = _nodes[ref - FIRST_NODE];
+      for (Ref& child : node.children) {
+        child = self(child, self);
+      }
+      nodes.emplace_back(node);
+      remapped = FIRST_NODE + nodes.size() - 1;
+    }
+    return remapped;
+  };
+
+  for (auto& [chunk_index, column] : _chunks) {
+    if (column_remap[column] == UINT32_MAX) {
+      Roots roots = _columns[column];
+      for (Ref& root : roots) {
+        root = keep(root, keep);
+      }
+      columns.emplace_back(roots);
+      column_remap[column] = columns.size() - 1;
+    }
+    column = column_remap[column];
+  }
+
+  _nodes.swap(nodes);
+  _columns.swap(columns);
+  _node_index.rebuild(_nodes, _node_index._slots.size());
+  _column_index.rebuild(_columns, _column_index._slots.size());
+  _live_after_collect = _nodes.size() + _columns.size();
+}
+
+size_t FarField::bytes() const {
+  // an unordered_map entry is a heap node with a next pointer and the cached hash, plus its bucket
+  size_t chunk_entry = sizeof(decltype(_chunks)::value_type) + sizeof(void*) + sizeof(size_t);
+  return _nodes.capacity() * sizeof(Node) + _node_index.bytes()
+       + _columns.capacity() * sizeof(Roots) + _column_index.bytes()
+       + _chunks.size() * chunk_entry + _chunks.bucket_count() * sizeof(void*);
+}
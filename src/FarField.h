@@ -0,0 +1,135 @@
+#pragma once
+
+#include "Config.h"
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/gtx/hash.hpp>
+
+#include <sys/types.h>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+struct Column;
+
+/// a downsampled copy of every chunk that has been seen, kept after the chunk itself is evicted.
+///
+/// each section becomes an octree over cells of FAR_FIELD_SCALE^3 blocks, and identical subtrees
+/// are stored once (hash consing), so the octrees form a DAG shared by the whole world: all stone,
+/// all air and the same stretch of hillside cost nothing the second time. a chunk is a column of
+/// section roots, deduplicated the same way, so most explored chunks cost a map entry and little else.
+struct FarField {
+  static constexpr int CELLS = SECTION_SIZE / FAR_FIELD_SCALE; // cells along a section edge
+  static constexpr int LEVELS = CELLS == 1 ? 0 : CELLS == 2 ? 1 : CELLS == 4 ? 2 : CELLS == 8 ? 3 : 4;
+  static constexpr int CHUNK_CELLS = CHUNK_SIZE / FAR_FIELD_SCALE;
+  static constexpr int HEIGHT_CELLS = CHUNK_HEIGHT / FAR_FIELD_SCALE;
+
+  /// below 256 a subtree that is that one block all the way down, otherwise a node index + 256
+  using Ref = uint32_t;
+  static constexpr Ref FIRST_NODE = 256;
+
+  struct Node {
+    std::array<Ref, 8> children; // octant (x, y, z) is child x + 2y + 4z
+    u_char block;                // what this node looks like from far enough away
+
+    bool operator==(const Node& o) const { return children == o.children; }
+  };
+
+  struct NodeHash {
+    size_t operator()(const Node& node) const {
+      size_t h = 0;
+      for (Ref child : node.children) {
+        h = h * 0x9E3779B1 + child;
+      }
+      return h;
+    }
+  };
+
+  using Roots = std::array<Ref, SECTION_COUNT>;
+
+  struct RootsHash {
+    size_t operator()(const Roots& roots) const {
+      size_t h = 0;
+      for (Ref root : roots) {
+        h = h * 0x9E3779B1 + root;
+      }
+      return h;
+    }
+  };
+
+  /// hash consing over values kept in a vector: open addressing on 4 byte indices,
+  /// so deduplicating a value costs a few bytes next to the value itself
+  template <typename T, typename Hash>
+  struct InternTable {
+    static constexpr uint32_t EMPTY = UINT32_MAX;
+    std::vector<uint32_t> _slots;
+
+    /// index of value in values, appending it if it is new
+    uint32_t intern(std::vector<T>& values, const T& value) {
+      if ((values.size() + 1) * 2 > _slots.size()) {
+        rebuild(values, std::max<size_t>(1024, _slots.size() * 2));
+      }
+      size_t mask = _slots.size() - 1;
+      for (size_t slot = Hash{}(value) & mask; ; slot = (slot + 1) & mask) {
+        if (_slots[slot] == EMPTY) {
+          values.emplace_back(value);
+          return _slots[slot] = values.size() - 1;
+        }
+        if (values[_slots[slot]] == value) {
+          return _slots[slot];
+        }
+      }
+    }
+
+    /// index values from scratch, slots is a power of two
+    void rebuild(const std::vector<T>& values, size_t slots) {
+      _slots.assign(slots, EMPTY);
+      size_t mask = slots - 1;
+      for (uint32_t i = 0; i < values.size(); ++i) {
+        size_t slot = Hash{}(values[i]) & mask;
+        while (_slots[slot] != EMPTY) {
+          slot = (slot + 1) & mask;
+        }
+        _slots[slot] = i;
+      }
+    }
+
+    size_t bytes() const { return _slots.capacity() * sizeof(uint32_t); }
+  };
+
+  std::vector<Node> _nodes;
+  InternTable<Node, NodeHash> _node_index;
+  std::vector<Roots> _columns;
+  InternTable<Roots, RootsHash> _column_index;
+  std::unordered_map<glm::ivec2, uint32_t> _chunks; // chunk index to its column
+
+  size_t _live_after_collect = 0; // nodes and columns after the last collect, so garbage can be bounded
+
+  /// take a new copy of a chunk, replacing any older one. whatever the old copy shared stays shared
+  void update(glm::ivec2 chunk_index, const Column& column);
+
+  bool explored(glm::ivec2 chunk_index) const { return _chunks.count(chunk_index); }
+
+  /// the block a cell looks like at a level of detail: level 0 cells are FAR_FIELD_SCALE blocks wide,
+  /// every level up doubles that. cell is in cells of that level, inside the chunk
+  u_char sample(glm::ivec2 chunk_index, glm::ivec3 cell, int level) const;
+
+  /// the whole chunk at a level of detail, x then y then z, each axis CHUNK_CELLS >> level
+  /// (HEIGHT_CELLS >> level for y) long. this is what distant rendering and the map draw from
+  void extract(glm::ivec2 chunk_index, int level, std::vector<u_char>& cells) const;
+
+  /// drop nodes and columns no chunk reaches any more
+  void collect();
+
+  /// everything held, containers and their bookkeeping included
+  size_t bytes() const;
+
+  size_t bytesPerChunk() const { return _chunks.empty() ? 0 : bytes() / _chunks.size(); }
+
+private:
+  Ref build(const u_char* cells, int x, int y, int z, int size);
+  static u_char represent(const u_char* blocks, int count);
+};
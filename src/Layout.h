@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Config.h"
+
+#include <array>
+
+/// voxel orders inside a 16^3 section. every voxel access goes through Section::index,
+/// which uses VoxelLayout below, so switching layouts is a rebuild with -DVOXEL_LAYOUT=<name>.
+///   saves are written in Linear order whatever the layout, see ChunkStore.
+namespace Layout {
+  static_assert(SECTION_SIZE == 16, "layouts assume 4 bits per axis");
+
+  /// [x][y][z], z contiguous. the order chunks had before sections
+  struct Linear {
+    static constexpr int index(int i, int j, int k) {
+      return (i * SECTION_SIZE + j) * SECTION_SIZE + k;
+    }
+  };
+
+  /// [x][z][y], columns contiguous in y, like the generator writes them
+  struct YMajor {
+    static constexpr int index(int i, int j, int k) {
+      return (i * SECTION_SIZE + k) * SECTION_SIZE + j;
+    }
+  };
+
+  /// Z-order: the bits of x, y and z interleaved, so all six neighbours of a voxel are near it
+  struct Morton {
+    /// the 4 bits of v spread out to every third bit
+    static constexpr std::array<int, 16> SPREAD = [] {
+      std::array<int, 16> spread {};
+      for (int v = 0; v < 16; ++v) {
+        for (int b = 0; b < 4; ++b) {
+          spread[v] |= ((v >> b) & 1) << (3 * b);
+        }
+      }
+      return spread;
+    }();
+
+    static constexpr int index(int i, int j, int k) {
+      return SPREAD[i] | (SPREAD[j] << 1) | (SPREAD[k] << 2);
+    }
+  };
+}
+
+#ifndef VOXEL_LAYOUT
+#define VOXEL_LAYOUT Linear
+#endif
+
+using VoxelLayout = Layout::VOXEL_LAYOUT;
@@ -0,0 +1,310 @@
+#include "Light.h"
+#include "World.h"
+
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+  /// a voxel and the column it is in
+  struct Node {
+    Column* column;
+    int i, j, k;
+  };
+
+  /// +x, +z, -x, -z like Chunk::NEIGHBOURS, then +y, -y
+  constexpr int STEP[6][3] = {{1, 0, 0}, {0, 0, 1}, {-1, 0, 0}, {0, 0, -1}, {0, 1, 0}, {0, -1, 0}};
+  constexpr int DOWN = 5;
+
+  /// the column across side 0 .. 3 of a column, or nullptr to stop there
+  using Across = Column* (*)(Column* column, int side);
+
+  Column* nothingAcross(Column*, int) {
+    return nullptr;
+  }
+
+  /// a chunk is lit once all its generation passes are in, so caves and trees are never relit block by block
+  bool lit(const Chunk* chunk) {
+    return chunk->_state >= Chunk::State::Generated;
+  }
+
+  /// lit neighbours only: a chunk still being generated has no light to give or take
+  Column* chunksAcross(Column* column, int side) {
+    Chunk* next = static_cast<Chunk*>(column)->_neighbours[side];
+    return next && lit(next) ? next : nullptr;
+  }
+
+  /// the sections of every column whose faces may show light that changed. the neighbours of a column
+  /// are not marked for light on its border: they see that in its edges, see World::remesh
+  using ChangedColumns = std::unordered_map<Column*, uint32_t>;
+
+  /// one of the two nibbles, and the breadth-first passes that move it around
+  struct Channel {
+    bool sky;
+    Across across;
+    ChangedColumns* changed = nullptr;       // columns whose light this pass wrote to, if wanted
+    mutable Column* last_changed = nullptr;  // saves a hash lookup per write inside one column
+    mutable uint32_t* last = nullptr;
+
+    int get(const Node& n) const {
+      u_char light = n.column->light(n.i, n.j, n.k);
+      return sky ? Light::sky(light) : Light::block(light);
+    }
+
+    void set(const Node& n, int level) const {
+      u_char light = n.column->light(n.i, n.j, n.k);
+      n.column->setLight(n.i, n.j, n.k, sky ? Light::pack(level, Light::block(light)) : Light::pack(Light::sky(light), level));
+      if (changed) {
+        if (n.column != last_changed) {
+          last = &(*changed)[n.column];
+          last_changed = n.column;
+        }
+        *last |= Column::sectionsAround(n.j);
+      }
+    }
+
+    /// the voxel one step in direction d, possibly in the next column. false off the world or into nothing
+    bool step(const Node& n, int d, Node& next) const {
+      next = {n.column, n.i + STEP[d][0], n.j + STEP[d][1], n.k + STEP[d][2]};
+      if (next.j < 0 || next.j >= CHUNK_HEIGHT) {
+        return false;
+      }
+      if (next.i < 0 || next.i >= CHUNK_SIZE || next.k < 0 || next.k >= CHUNK_SIZE) {
+        next.column = across(n.column, d);
+        next.i = (next.i + CHUNK_SIZE) % CHUNK_SIZE;
+        next.k = (next.k + CHUNK_SIZE) % CHUNK_SIZE;
+        return next.column != nullptr;
+      }
+      return true;
+    }
+
+    /// what level passes from a voxel at level into next: one less, except skylight at full strength
+    /// falling into air, which keeps going
+    int passed(int level, int d, u_char next_block) const {
+      return sky && d == DOWN && level == Light::MAX && next_block == Terrain::AIR ? level : level - 1;
+    }
+
+    /// raise the light around every queued voxel, and around those, until nothing gets brighter
+    void spread(std::vector<Node>& queue) const {
+      for (size_t q = 0; q < queue.size(); ++q) {
+        Node n = queue[q];
+        int level = get(n);
+        if (level <= 1) {
+          continue;
+        }
+        for (int d = 0; d < 6; ++d) {
+          Node next;
+          if (not step(n, d, next)) {
+            continue;
+          }
+          u_char block = next.column->get(next.i, next.j, next.k);
+          if (Section::isOpaque(block)) {
+            continue;
+          }
+          int level_next = passed(level, d, block);
+          if (get(next) < level_next) {
+            set(next, level_next);
+            queue.push_back(next);
+          }
+        }
+      }
+      queue.clear();
+    }
+
+    /// removed holds voxels just set dark with the level they had. darken everything that level fed,
+    /// and queue the brighter voxels met along the way in refill, to spread back into the dark
+    void unspread(std::vector<std::pair<Node, int>>& removed, std::vector<Node>& refill) const {
+      for (size_t q = 0; q < removed.size(); ++q) {
+        auto [n, level] = removed[q];
+        for (int d = 0; d < 6; ++d) {
+          Node next;
+          if (not step(n, d, next)) {
+            continue;
+          }
+          int level_next = get(next);
+          if (level_next == 0) {
+            continue;
+          }
+          u_char block = next.column->get(next.i, next.j, next.k);
+          bool emitter = not sky && Terrain::EMISSION[block] != 0;
+          bool fed = level_next < level || (sky && d == DOWN && level == Light::MAX && level_next == Light::MAX);
+          if (fed && not emitter) {
+            set(next, 0);
+            removed.push_back({next, level_next});
+          } else {
+            refill.push_back(next);
+          }
+        }
+      }
+      removed.clear();
+    }
+  };
+
+  /// the chunks that changed light get a new version so meshes in flight are dropped, and the sections
+  /// of built chunks that show it are marked to be meshed again. their light storage is counted again
+  void invalidate(World& world, const ChangedColumns& changed) {
+    for (const auto& [column, sections] : changed) {
+      Chunk* chunk = static_cast<Chunk*>(column);
+      world.account(chunk);
+      chunk->touch();
+      if (chunk->_state == Chunk::State::Built) {
+        chunk->_dirty |= sections;
+      }
+    }
+  }
+
+  /// queue the voxels on both sides of every border between chunk and a lit neighbour,
+  /// so light on either side spreads across
+  void seedBorders(Chunk* chunk, std::vector<Node>& queue) {
+    for (int side = 0; side < 4; ++side) {
+      Chunk* next = chunk->_neighbours[side];
+      if (not next || not lit(next)) {
+        continue;
+      }
+      for (int a = 0; a < CHUNK_SIZE; ++a)
+      for (int j = 0; j < CHUNK_HEIGHT; ++j) {
+        // +x, +z, -x, -z: this chunk's last row on that side, the neighbour's first
+        switch (side) {
+          case 0: queue.push_back({chunk, CHUNK_SIZE - 1, j, a}); queue.push_back({next, 0, j, a}); break;
+          case 1: queue.push_back({chunk, a, j, CHUNK_SIZE - 1}); queue.push_back({next, a, j, 0}); break;
+          case 2: queue.push_back({chunk, 0, j, a}); queue.push_back({next, CHUNK_SIZE - 1, j, a}); break;
+          case 3: queue.push_back({chunk, a, j, 0}); queue.push_back({next, a, j, CHUNK_SIZE - 1}); break;
+        }
+      }
+    }
+  }
+
+  /// spread light across the borders of chunks lit on their own
+  void joinAll(World& world, const std::vector<Chunk*>& chunks) {
+    ChangedColumns changed;
+    std::vector<Node> queue;
+    for (bool sky : {true, false}) {
+      for (Chunk* chunk : chunks) {
+        seedBorders(chunk, queue);
+      }
+      Channel {sky, chunksAcross, &changed}.spread(queue);
+    }
+    invalidate(world, changed);
+  }
+}
+
+void Light::initial(Column& column) {
+  for (LightSection& light : column._light) {
+    light.fill(0);
+  }
+
+  // everything above the highest block is open sky, and so is every column of air down to its first block
+  int open = (column.heights().y + SECTION_SIZE) / SECTION_SIZE; // first section with nothing in or above it
+  for (int s = open; s < SECTION_COUNT; ++s) {
+    column._light[s].fill(SKY);
+  }
+
+  std::vector<Node> sky_queue, block_queue;
+  for (int i = 0; i < CHUNK_SIZE; ++i)
+  for (int k = 0; k < CHUNK_SIZE; ++k) {
+    for (int j = open * SECTION_SIZE - 1; j >= 0 && column.get(i, j, k) == Terrain::AIR; --j) {
+      column.setLight(i, j, k, SKY);
+      sky_queue.push_back({&column, i, j, k});
+    }
+  }
+
+  uint32_t emitters = 0;
+  for (int b = 0; b < Terrain::BLOCK_COUNT; ++b) {
+    emitters |= (Terrain::BLOCKS[b].light != 0) << b;
+  }
+  for (int s = 0; s < SECTION_COUNT; ++s) {
+    if (not (column._sections[s].present() & emitters)) {
+      continue;
+    }
+    for (int i = 0; i < SECTION_SIZE; ++i)
+    for (int j = s * SECTION_SIZE; j < (s + 1) * SECTION_SIZE; ++j)
+    for (int k = 0; k < SECTION_SIZE; ++k) {
+      if (int emission = Terrain::EMISSION[column.get(i, j, k)]) {
+        column.setLight(i, j, k, pack(sky(column.light(i, j, k)), emission));
+        block_queue.push_back({&column, i, j, k});
+      }
+    }
+  }
+
+  Channel {true, nothingAcross}.spread(sky_queue);
+  Channel {false, nothingAcross}.spread(block_queue);
+
+  for (LightSection& light : column._light) {
+    light.compact();
+  }
+}
+
+void Light::update(World& world, const std::vector<glm::ivec3>& changed) {
+  ChangedColumns touched;
+  std::vector<std::pair<Node, int>> removed;
+  std::vector<Node> refill;
+
+  for (bool sky : {true, false}) {
+    Channel channel {sky, chunksAcross, &touched};
+    for (glm::ivec3 p : changed) {
+      auto it = world._chunks.find(World::toChunk(p));
+      if (it == world._chunks.end() || not lit(it->second) || p.y < 0 || p.y >= CHUNK_HEIGHT) {
+        continue;
+      }
+      glm::ivec3 local = World::toLocal(p);
+      Node n {it->second, local.x, local.y, local.z};
+
+      // the voxel loses whatever it had, then gets back what it gives off itself
+      // and whatever its neighbours pass in
+      if (int level = channel.get(n)) {
+        channel.set(n, 0);
+        removed.push_back({n, level});
+      }
+      int emission = sky ? 0 : Terrain::EMISSION[n.column->get(n.i, n.j, n.k)];
+      if (emission) {
+        channel.set(n, emission);
+        refill.push_back(n);
+      }
+      for (int d = 0; d < 6; ++d) {
+        Node next;
+        if (channel.step(n, d, next)) {
+          refill.push_back(next);
+        }
+      }
+    }
+    channel.unspread(removed, refill);
+    channel.spread(refill);
+  }
+  invalidate(world, touched);
+}
+
+void Light::relight(World& world, const std::vector<glm::ivec2>& chunks) {
+  std::unordered_set<Chunk*> around;
+  for (glm::ivec2 chunk_index : chunks) {
+    auto it = world._chunks.find(chunk_index);
+    if (it == world._chunks.end()) {
+      continue;
+    }
+    around.insert(it->second);
+    for (Chunk* next : it->second->_neighbours) {
+      if (next) {
+        around.insert(next);
+      }
+    }
+  }
+
+  std::vector<Chunk*> relit;
+  for (Chunk* chunk : around) {
+    if (lit(chunk)) {
+      Light::initial(*chunk);
+      relit.push_back(chunk);
+    }
+  }
+  joinAll(world, relit);
+  // built chunks keep drawing what they have until World::remesh replaces it
+  for (Chunk* chunk : relit) {
+    world.account(chunk);
+    chunk->touch();
+    if (chunk->_state == Chunk::State::Built) {
+      chunk->_dirty = Column::ALL_SECTIONS;
+    }
+  }
+}
+
+void Light::join(World& world, glm::ivec2 chunk_index) {
+  joinAll(world, {world.chunk(chunk_index)});
+}
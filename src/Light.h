@@ -0,0 +1,144 @@
+#pragma once
+
+#include "Config.h"
+#include "Section.h"
+#include "Pool.h"
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+
+#include <sys/types.h>
+
+#include <array>
+#include <atomic>
+#include <vector>
+
+struct Column;
+struct World;
+
+/// light levels 0 .. 15, two to a byte: skylight in the high nibble, block light in the low one.
+///
+/// skylight comes straight down from above the world at full strength until it hits anything but air,
+/// block light comes from emitters in the block registry, and both lose a level per block sideways.
+/// light is worked out on the CPU when blocks change and baked into the mesh per face.
+namespace Light {
+  constexpr int MAX = 15;
+  constexpr u_char SKY = MAX << 4; // open sky and no block light
+
+  constexpr int sky(u_char light) { return light >> 4; }
+  constexpr int block(u_char light) { return light & 0xF; }
+  constexpr u_char pack(int sky, int block) { return u_char(sky << 4 | block); }
+
+  /// light a column on its own, as if nothing around it were loaded. touches nothing but the column
+  void initial(Column& column);
+
+  /// spread light both ways across the borders of a chunk that was lit on its own
+  void join(World& world, glm::ivec2 chunk_index);
+
+  /// blocks at these positions changed in lit chunks: take away the light they held or passed on,
+  /// then spread light back in. only the region the old and new light reach is visited
+  void update(World& world, const std::vector<glm::ivec3>& changed);
+
+  /// relight chunks from scratch and pull in light across their borders.
+  /// light reaches at most MAX - 1 blocks sideways, so relighting a chunk and the chunks around it
+  /// is exact no matter what changed in the middle one
+  void relight(World& world, const std::vector<glm::ivec2>& chunks);
+}
+
+/// the light of a 16^3 section, see Light.
+/// like Section, uniform light (open sky, solid rock) holds no storage, and storage is reference counted
+/// and copied on write, so a mesh snapshot keeps the light it was taken with
+struct LightSection {
+  struct Storage {
+    std::array<u_char, Section::VOLUME> values;
+    std::atomic<int> refs {1};
+
+    Storage() = default;
+    Storage(const Storage& o): values(o.values) {}
+  };
+
+  using Pool = SlabPool<Storage, 2 * 1024 * 1024>;
+
+  Storage* _data = nullptr;
+  u_char _uniform = 0; // the light of every voxel while there is no storage
+
+  LightSection() = default;
+  LightSection(const LightSection& o): _data(o._data), _uniform(o._uniform) { retain(); }
+  LightSection(LightSection&& o): _data(o._data), _uniform(o._uniform) { o._data = nullptr; }
+  LightSection& operator=(const LightSection& o) {
+    if (this != &o) {
+      release();
+      _data = o._data;
+      _uniform = o._uniform;
+      retain();
+    }
+    return *this;
+  }
+  LightSection& operator=(LightSection&& o) {
+    std::swap(_data, o._data);
+    std::swap(_uniform, o._uniform);
+    return *this;
+  }
+  ~LightSection() { release(); }
+
+  static Pool& pool() {
+    static Pool pool;
+    return pool;
+  }
+
+  u_char get(int i, int j, int k) const {
+    return _data ? _data->values[Section::index(i, j, k)] : _uniform;
+  }
+
+  void set(int i, int j, int k, u_char light) {
+    if (get(i, j, k) == light) {
+      return;
+    }
+    makeWritable();
+    _data->values[Section::index(i, j, k)] = light;
+  }
+
+  void fill(u_char light) {
+    release();
+    _uniform = light;
+  }
+
+  bool uniform() const { return _data == nullptr; }
+
+  /// give storage back if every voxel ended up with the same light
+  void compact() {
+    if (_data && std::all_of(_data->values.begin(), _data->values.end(),
+                             [v = _data->values[0]](u_char light) { return light == v; })) {
+      u_char light = _data->values[0];
+      release();
+      _uniform = light;
+    }
+  }
+
+  size_t bytes() const { return _data ? sizeof(Storage) : 0; }
+
+private:
+  void makeWritable() {
+    if (_data == nullptr) {
+      _data = pool().create();
+      _data->values.fill(_uniform);
+    } else if (_data->refs.load(std::memory_order_acquire) > 1) {
+      Storage* copy = pool().create(*_data);
+      release();
+      _data = copy;
+    }
+  }
+
+  void retain() {
+    if (_data) {
+      _data->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  void release() {
+    if (_data && _data->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      pool().destroy(_data);
+    }
+    _data = nullptr;
+  }
+};
@@ -0,0 +1,162 @@
+#include "Lod.h"
+
+#include <algorithm>
+#include <utility>
+
+int Lod::level(int current, int distance) {
+  if constexpr(not MESH_LOD) {
+    return 0;
+  }
+  int level = current;
+  while (level < LOD_LEVELS - 1 && distance > LOD_DISTANCES[level]) {
+    ++level;
+  }
+  while (level > 0 && distance <= LOD_DISTANCES[level - 1] - LOD_HYSTERESIS) {
+    --level;
+  }
+  return level;
+}
+
+Column Lod::downsample(const Column& column, int level) {
+  const int size = 1 << level;
+  const int volume = size * size * size;
+  Column coarse;
+  for (int s = 0; s < SECTION_COUNT; ++s) {
+    const Section& section = column._sections[s];
+    const LightSection& light = column._light[s];
+    if (section.uniform()) {
+      coarse._sections[s] = section;
+    }
+    if (light.uniform()) {
+      coarse._light[s] = light;
+    }
+    if (section.uniform() && light.uniform()) {
+      continue;
+    }
+
+    for (int ci = 0; ci < SECTION_SIZE; ci += size)
+    for (int cj = 0; cj < SECTION_SIZE; cj += size)
+    for (int ck = 0; ck < SECTION_SIZE; ck += size) {
+      int j0 = s * SECTION_SIZE + cj;
+      if (not section.uniform()) {
+        // the top block of each column of the cell, counted
+        std::array<std::pair<u_char, int>, 16> tops;
+        int kinds = 0, filled = 0;
+        for (int i = ci; i < ci + size; ++i)
+        for (int k = ck; k < ck + size; ++k) {
+          bool topped = false;
+          for (int j = j0 + size - 1; j >= j0; --j) {
+            u_char block = column.get(i, j, k);
+            if (block == Terrain::AIR) {
+              continue;
+            }
+            ++filled;
+            if (not topped) {
+              topped = true;
+              auto seen = std::find_if(tops.begin(), tops.begin() + kinds, [block](auto& top) { return top.first == block; });
+              if (seen == tops.begin() + kinds) {
+                tops[kinds++] = {block, 0};
+              }
+              seen->second++;
+            }
+          }
+        }
+        if (filled * 2 >= volume) {
+          u_char block = std::max_element(tops.begin(), tops.begin() + kinds,
+                                          [](auto& a, auto& b) { return a.second < b.second; })->first;
+          coarse.fill({{ci, j0, ck}, {ci + size, j0 + size, ck + size}}, block);
+        }
+      }
+
+      if (not light.uniform()) {
+        u_char brightest = 0;
+        for (int i = ci; i < ci + size; ++i)
+        for (int j = j0; j < j0 + size; ++j)
+        for (int k = ck; k < ck + size; ++k) {
+          u_char here = column.light(i, j, k);
+          brightest = Light::pack(std::max(Light::sky(brightest), Light::sky(here)),
+                                  std::max(Light::block(brightest), Light::block(here)));
+        }
+        for (int i = ci; i < ci + size; ++i)
+        for (int j = j0; j < j0 + size; ++j)
+        for (int k = ck; k < ck + size; ++k) {
+          coarse.setLight(i, j, k, brightest);
+        }
+      }
+    }
+    coarse._sections[s].compact();
+    coarse._light[s].compact();
+  }
+  return coarse;
+}
+
+void Lod::skirt(const Column& column, int side, const Edge& neighbour, std::vector<Instance>& instances) {
+  // the direction out of each side, and where the side is
+  static constexpr GLuint OUT[4] = {0, 2, 3, 5};
+  const int at = side < 2 ? CHUNK_SIZE - 1 : 0;
+  const bool along_x = side % 2;
+  Edge own = column.edge(side);
+
+  // walking down each column across the side, the light of the last open voxel seen
+  std::array<u_char, CHUNK_HEIGHT * CHUNK_SIZE> lit;
+  for (int t = 0; t < CHUNK_SIZE; ++t) {
+    u_char above = Light::SKY;
+    for (int j = CHUNK_HEIGHT - 1; j >= 0; --j) {
+      if (not (neighbour.opaque[j] >> t & 1)) {
+        above = neighbour.light[j * CHUNK_SIZE + t];
+      }
+      lit[j * CHUNK_SIZE + t] = above;
+    }
+  }
+
+  // runs up each column of the side, never out of a section, so they stay in section order
+  for (int s = 0; s < SECTION_COUNT; ++s)
+  for (int t = 0; t < CHUNK_SIZE; ++t) {
+    auto local = [&](int j) { return along_x ? glm::ivec3(t, j, at) : glm::ivec3(at, j, t); };
+    auto hidden = [&](int j) { return (own.opaque[j] & neighbour.opaque[j]) >> t & 1; };
+    for (int j = s * SECTION_SIZE; j < (s + 1) * SECTION_SIZE; ) {
+      if (not hidden(j)) {
+        ++j;
+        continue;
+      }
+      glm::ivec3 p = local(j);
+      u_char block = column.get(p.x, p.y, p.z);
+      u_char light = lit[j * CHUNK_SIZE + t];
+      int run = 1;
+      while (j + run < (s + 1) * SECTION_SIZE && hidden(j + run) && lit[(j + run) * CHUNK_SIZE + t] == light) {
+        glm::ivec3 q = local(j + run);
+        if (column.get(q.x, q.y, q.z) != block) {
+          break;
+        }
+        ++run;
+      }
+      // the rectangle's first axis is y for a face along x, its second for a face along z
+      instances.emplace_back(p, OUT[side], block, light, along_x ? 1 : run, along_x ? run : 1);
+      j += run;
+    }
+  }
+}
+
+void Lod::mesh(const MeshJob& job, int level, LodMesh& lod) {
+  thread_local std::vector<Instance> instances;
+  thread_local std::vector<Instance> water_instances;
+
+  std::array<const Edge*, 4> neighbours;
+  for (int n = 0; n < 4; ++n) {
+    neighbours[n] = job.neighbours[n].get();
+  }
+  Column coarse = level > 0 ? downsample(job.column, level) : job.column;
+  if (level > 0) {
+    coarse.mesh(neighbours, instances, water_instances, true);
+    MeshJob::store(lod.instances, instances);
+    MeshJob::store(lod.water_instances, water_instances);
+  }
+  for (int n = 0; n < 4; ++n) {
+    instances.clear();
+    if (neighbours[n]) {
+      skirt(coarse, n, *neighbours[n], instances);
+    }
+    MeshJob::store(lod.skirts[n], instances);
+  }
+  lod.versions = job.versions;
+}
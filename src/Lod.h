@@ -0,0 +1,34 @@
+#pragma once
+
+#include "Config.h"
+#include "Chunk.h"
+
+#include <vector>
+
+/// levels of detail for chunks away from the player. level l draws a chunk from its blocks downsampled
+/// into cells of 2^l blocks on a side, meshed greedily like any other column, so a hillside that costs
+/// hundreds of faces up close is a few dozen rectangles in the far ring.
+///
+/// the surfaces of two chunks at different levels do not meet at their shared side. each side of a chunk
+/// has a skirt for that: the faces of its border blocks that the neighbour hides, drawn only while the
+/// neighbour is at another level, so whichever surface is the higher one closes the gap in front of it.
+///   the meshes of each level are kept per chunk (see LodMesh) and made again only once the chunk or an
+///   edge of a neighbour has changed, a few per frame from World::remesh
+namespace Lod {
+  /// the level a chunk this many chunks from the player is drawn at, given the level it has now:
+  /// further out switches as soon as a line is crossed, closer in only LOD_HYSTERESIS chunks past it
+  int level(int current, int distance);
+
+  /// the column with every cell of 2^level blocks on a side made of one block: air unless at least half of
+  /// the cell is something else, and then the block its columns show on top most often, so grass stays on
+  /// top of the hills. the light of a cell is the brightest in it
+  Column downsample(const Column& column, int level);
+
+  /// the faces of the blocks on side 0 .. 3 of column that face out where neighbour, the edge across that
+  /// side, is opaque too. lit like the open voxel above them across the side, they stand for the neighbour's
+  /// own faces where its surface is higher than the one drawn here
+  void skirt(const Column& column, int side, const Edge& neighbour, std::vector<Instance>& instances);
+
+  /// the meshes of a level of the chunk in job, and its skirts
+  void mesh(const MeshJob& job, int level, LodMesh& lod);
+}
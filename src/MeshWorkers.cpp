@@ -0,0 +1,69 @@
+#include "MeshWorkers.h"
+#include "World.h"
+
+MeshWorkers::MeshWorkers(int threads) {
+  for (int t = 0; t < threads; ++t) {
+    _threads.emplace_back([this]() { work(); });
+  }
+}
+
+MeshWorkers::~MeshWorkers() {
+  {
+    std::lock_guard<std::mutex> lock {_mutex};
+    _running = false;
+  }
+  _wake.notify_all();
+  for (std::thread& thread : _threads) {
+    thread.join();
+  }
+}
+
+void MeshWorkers::work() {
+  std::unique_lock<std::mutex> lock {_mutex};
+  while (true) {
+    _wake.wait(lock, [this]() { return not _running || not _jobs.empty(); });
+    if (not _running) {
+      return;
+    }
+    MeshJob job = std::move(_jobs.front());
+    _jobs.pop_front();
+
+    lock.unlock();
+    MeshResult result = job.run();
+    lock.lock();
+    _done.emplace_back(std::move(result));
+  }
+}
+
+bool MeshWorkers::submit(const World& world, glm::ivec2 chunk_index) {
+  if (busy(chunk_index) || _in_flight.size() >= MESH_JOBS_IN_FLIGHT) {
+    return false;
+  }
+  MeshJob job = world.snapshot(chunk_index);
+  _in_flight.insert(chunk_index);
+  {
+    std::lock_guard<std::mutex> lock {_mutex};
+    _jobs.emplace_back(std::move(job));
+  }
+  _wake.notify_one();
+  return true;
+}
+
+size_t MeshWorkers::drain(World& world) {
+  std::vector<MeshResult> done;
+  {
+    std::lock_guard<std::mutex> lock {_mutex};
+    done.swap(_done);
+  }
+  size_t installed = 0;
+  for (MeshResult& result : done) {
+    _in_flight.erase(result.chunk_index);
+    if (world.install(result)) {
+      ++installed;
+    } else {
+      ++_stale;
+    }
+  }
+  _installed += installed;
+  return installed;
+}
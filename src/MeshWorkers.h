@@ -0,0 +1,51 @@
+#pragma once
+
+#include "Config.h"
+#include "Chunk.h"
+
+#include <glm/vec2.hpp>
+#include <glm/gtx/hash.hpp>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+struct World;
+
+/// meshing off the render thread. the main thread hands out snapshots (see World::snapshot), the workers mesh
+/// them into meshes of their own, and the main thread installs whatever came back.
+///   a chunk keeps drawing the mesh it has until the new one is swapped in by World::install, so nothing
+///   disappears while it is being meshed. a result an edit made stale is dropped, and the chunk goes out again
+struct MeshWorkers {
+  std::vector<std::thread> _threads;
+  std::mutex _mutex;
+  std::condition_variable _wake;
+  std::deque<MeshJob> _jobs;        // waiting for a worker
+  std::vector<MeshResult> _done;    // waiting for the main thread
+  bool _running = true;
+
+  std::unordered_set<glm::ivec2> _in_flight; // chunks handed out and not back yet, main thread only
+  size_t _installed = 0;
+  size_t _stale = 0;
+
+  /// one thread less than the cores, the render thread has one to itself
+  MeshWorkers(int threads = std::max(2u, std::thread::hardware_concurrency()) - 1);
+  ~MeshWorkers();
+
+  /// mesh chunk_index as it is now. false if it is out already, or MESH_JOBS_IN_FLIGHT are
+  bool submit(const World& world, glm::ivec2 chunk_index);
+
+  /// install every result that is back, returns how many went in
+  size_t drain(World& world);
+
+  bool busy(glm::ivec2 chunk_index) const { return _in_flight.count(chunk_index); }
+  size_t inFlight() const { return _in_flight.size(); }
+
+private:
+  void work();
+};
@@ -19,7 +19,7 @@ void Player::handleTick(const World& world) {
     // FIXME: cast ray to ground and then ground if reached by current velocity and then place player on ground
     if (_grounded) {
       auto wi = glm::round(feet());
-      if (world(wi.x, wi.y, wi.z)) {
+      if (not world.isAir(wi.x, wi.y, wi.z)) {
         camera.setPos({feet().x, wi.y + 0.5f + 1.75f, feet().z});
       }
     }
@@ -81,7 +81,7 @@ void Player::handleMouse(int button, int action, int mods, World& world) {
         block = currblock;
         placement_found = true;
       }
-      if (world(block.x, block.y, block.z) != 0) {
+      if (not world.isAir(block.x, block.y, block.z)) {
         found = true;
         break;
       }
@@ -91,35 +91,20 @@ void Player::handleMouse(int button, int action, int mods, World& world) {
       return;
     }
 
-    bool action_taken = false;
+    // edits reach the mesher through the world's change journal, see World::publish
     if (button == GLFW_MOUSE_BUTTON_LEFT) {
-      world(block.x, block.y, block.z) = 0;
-      action_taken = true;
+      world.set(block.x, block.y, block.z, 0);
     }
 
     if (button == GLFW_MOUSE_BUTTON_MIDDLE) {
-      auto& world_block = world(block.x, block.y, block.z);
+      auto world_block = world(block.x, block.y, block.z);
       if (world_block != 0) {
         _held_block = world_block;
-        action_taken = true; //FIXME: technically not necessary, but useful for debugging
       }
     }
 
     if (placement_found && button == GLFW_MOUSE_BUTTON_RIGHT && _held_block != 0) {
-      world(prev.x, prev.y, prev.z) = _held_block;
-      action_taken = true;
+      world.set(prev.x, prev.y, prev.z, _held_block);
     }
-
-    if (action_taken) {
-      glm::ivec2 chunk = World::toChunk(block);
-      world.chunk(chunk)->_state = Chunk::State::Generated;
-
-      //TODO figure out chunks that need rerendering intelligently
-      world.chunk(chunk + glm::ivec2(1, 0) )->_state = Chunk::State::Generated;
-      world.chunk(chunk + glm::ivec2(-1, 0))->_state = Chunk::State::Generated;
-      world.chunk(chunk + glm::ivec2(0, 1) )->_state = Chunk::State::Generated;
-      world.chunk(chunk + glm::ivec2(0, -1))->_state = Chunk::State::Generated;
-    }
-    // world._might_need_building = true;
   }
 }
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "Camera.h"
+#include "Terrain.h"
 
 #include <GLFW/glfw3.h>
 #include <string>
@@ -77,6 +78,11 @@ struct Player {
       }
     }
 
+    // lamps are never generated, so they come from here
+    if (key == GLFW_KEY_L && action == GLFW_RELEASE) {
+      _held_block = Terrain::LAMP;
+    }
+
     if (key == GLFW_KEY_SPACE && _grounded && action == GLFW_PRESS && _current_mode == Mode::Survival) {
       _grounded = false;
       _velocity_y = 0.2;
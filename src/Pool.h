@@ -0,0 +1,164 @@
+#pragma once
+
+#include "Config.h"
+
+#include <sys/mman.h>
+
+#include <array>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+/// fixed-size objects carved out of big slabs, O(1) acquire and release.
+/// slabs are never handed back to the OS: released slots are recycled by the next acquire,
+/// so a world that streams chunks in and out settles at its peak and stops faulting pages.
+///   2 MB slabs are advised as transparent huge pages when POOL_HUGE_PAGES is set.
+template <typename T, size_t SLAB_BYTES>
+struct SlabPool {
+  static constexpr size_t SLOT_BYTES = (sizeof(T) + alignof(T) - 1) / alignof(T) * alignof(T);
+  static constexpr size_t SLOTS_PER_SLAB = SLAB_BYTES / SLOT_BYTES;
+  static_assert(SLOT_BYTES >= sizeof(void*), "a free slot has to hold the free list link");
+  static_assert(SLOTS_PER_SLAB > 0, "slab too small for one object");
+
+  struct FreeSlot { FreeSlot* next; };
+
+  std::mutex _mutex;
+  FreeSlot* _free = nullptr;
+  std::vector<void*> _slabs;
+
+  size_t _live = 0;     // slots handed out right now
+  size_t _acquires = 0; // every acquire, recycled or not
+
+  void* acquire() {
+    std::lock_guard<std::mutex> lock {_mutex};
+    if (_free == nullptr) {
+      grow();
+    }
+    FreeSlot* slot = _free;
+    _free = slot->next;
+    ++_live;
+    ++_acquires;
+    return slot;
+  }
+
+  void release(void* p) {
+    std::lock_guard<std::mutex> lock {_mutex};
+    FreeSlot* slot = static_cast<FreeSlot*>(p);
+    slot->next = _free;
+    _free = slot;
+    --_live;
+  }
+
+  template <typename... Args>
+  T* create(Args&&... args) {
+    return new (acquire()) T(std::forward<Args>(args)...);
+  }
+
+  void destroy(T* t) {
+    t->~T();
+    release(t);
+  }
+
+  size_t bytes() const { return _slabs.size() * SLAB_BYTES; }
+
+private:
+  void grow() {
+    void* slab = mmap(nullptr, SLAB_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (slab == MAP_FAILED) {
+      throw std::bad_alloc();
+    }
+#ifdef MADV_HUGEPAGE
+    if (POOL_HUGE_PAGES && SLAB_BYTES % (2 * 1024 * 1024) == 0) {
+      madvise(slab, SLAB_BYTES, MADV_HUGEPAGE);
+    }
+#endif
+    _slabs.emplace_back(slab);
+
+    // thread the new slots onto the free list in address order
+    char* base = static_cast<char*>(slab);
+    for (size_t i = SLOTS_PER_SLAB; i-- > 0; ) {
+      FreeSlot* slot = reinterpret_cast<FreeSlot*>(base + i * SLOT_BYTES);
+      slot->next = _free;
+      _free = slot;
+    }
+  }
+};
+
+/// power-of-two size classes for mesh output, from 256 B up.
+/// a rebuilt chunk mesh usually lands in the class it had before, so it reuses the buffer it just gave back.
+struct SizeClassPool {
+  static constexpr size_t MIN_CLASS_BYTES = 256;
+  static constexpr int CLASS_COUNT = 24;
+
+  std::mutex _mutex;
+  std::array<std::vector<void*>, CLASS_COUNT> _free;
+
+  size_t _acquires = 0;
+  size_t _fresh = 0;      // acquires that had to go to operator new
+  size_t _bytes = 0;      // bytes ever taken from operator new
+
+  static int sizeClass(size_t bytes) {
+    int c = 0;
+    while ((MIN_CLASS_BYTES << c) < bytes) {
+      ++c;
+    }
+    return c;
+  }
+
+  static size_t classBytes(int c) { return MIN_CLASS_BYTES << c; }
+
+  void* acquire(size_t bytes) {
+    int c = sizeClass(bytes);
+    std::lock_guard<std::mutex> lock {_mutex};
+    ++_acquires;
+    if (c >= CLASS_COUNT) {
+      ++_fresh;
+      return ::operator new(bytes);
+    }
+    if (_free[c].empty()) {
+      ++_fresh;
+      _bytes += classBytes(c);
+      return ::operator new(classBytes(c));
+    }
+    void* p = _free[c].back();
+    _free[c].pop_back();
+    return p;
+  }
+
+  void release(void* p, size_t bytes) {
+    int c = sizeClass(bytes);
+    if (c >= CLASS_COUNT) {
+      ::operator delete(p);
+      return;
+    }
+    std::lock_guard<std::mutex> lock {_mutex};
+    _free[c].emplace_back(p);
+  }
+};
+
+inline SizeClassPool& meshPool() {
+  static SizeClassPool pool;
+  return pool;
+}
+
+/// std allocator over meshPool(), so mesh vectors grow into whole size classes
+template <typename T>
+struct MeshAllocator {
+  using value_type = T;
+
+  MeshAllocator() = default;
+  template <typename U> MeshAllocator(const MeshAllocator<U>&) {}
+
+  T* allocate(size_t n) {
+    return static_cast<T*>(meshPool().acquire(n * sizeof(T)));
+  }
+
+  void deallocate(T* p, size_t n) {
+    meshPool().release(p, n * sizeof(T));
+  }
+
+  template <typename U> bool operator==(const MeshAllocator<U>&) const { return true; }
+  template <typename U> bool operator!=(const MeshAllocator<U>&) const { return false; }
+};
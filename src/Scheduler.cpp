@@ -0,0 +1,319 @@
+#include "Scheduler.h"
+#include "World.h"
+
+#include <cassert>
+#include <unordered_set>
+
+namespace {
+  constexpr int SIDES[6][3] = {{1, 0, 0}, {0, 0, 1}, {-1, 0, 0}, {0, 0, -1}, {0, 1, 0}, {0, -1, 0}};
+
+  /// random bits from a few integers, the same every time: a cheap counter based generator,
+  /// so every section has a stream of its own without keeping any state
+  uint32_t mix(uint64_t a, uint64_t b) {
+    uint64_t z = a * 0x9E3779B97F4A7C15ull + b;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return uint32_t(z ^ (z >> 31));
+  }
+
+  uint64_t key(glm::ivec3 p) {
+    return uint64_t(uint32_t(p.x)) << 32 ^ uint64_t(uint32_t(p.z)) << 9 ^ uint32_t(p.y);
+  }
+
+  /// the block at p, or otherwise if its chunk is not loaded and generated or p is off the world
+  u_char at(const World& world, glm::ivec3 p, u_char otherwise) {
+    if (p.y < 0 || p.y >= CHUNK_HEIGHT) {
+      return otherwise;
+    }
+    glm::ivec2 chunk_index = World::toChunk(p);
+    auto it = world._chunks.find(chunk_index);
+    if (it == world._chunks.end() || it->second->_state < Chunk::State::Generated) {
+      return otherwise;
+    }
+    glm::ivec3 local = World::toLocal(p);
+    return it->second->get(local.x, local.y, local.z);
+  }
+
+  /// a trunk within LEAF_REACH steps of the leaf at p through other leaves
+  bool heldUp(const World& world, glm::ivec3 p) {
+    std::vector<glm::ivec3> frontier {p}, next;
+    std::unordered_set<glm::ivec3> seen {p};
+    for (int step = 0; step < LEAF_REACH && not frontier.empty(); ++step) {
+      for (glm::ivec3 q : frontier) {
+        for (auto [x, y, z] : SIDES) {
+          glm::ivec3 n = q + glm::ivec3(x, y, z);
+          // an unloaded neighbour might hold the trunk, so it counts as one
+          u_char block = at(world, n, Terrain::DIRT);
+          if (block == Terrain::DIRT) {
+            return true;
+          }
+          if (block == Terrain::LEAF && seen.insert(n).second) {
+            next.push_back(n);
+          }
+        }
+      }
+      std::swap(frontier, next);
+      next.clear();
+    }
+    return false;
+  }
+}
+
+uint32_t& Scheduler::slot(uint64_t due) {
+  // the level is the highest byte in which due and now differ: the one that has to tick over first
+  uint64_t differ = due ^ _now;
+  int level = differ == 0 ? 0 : (63 - __builtin_clzll(differ)) / SLOT_BITS;
+  return _slots[level * SLOTS + ((due >> (level * SLOT_BITS)) & (SLOTS - 1))];
+}
+
+void Scheduler::link(uint32_t e) {
+  uint32_t& head = slot(_entries[e].due);
+  _entries[e].prev = NONE;
+  _entries[e].next = head;
+  if (head != NONE) {
+    _entries[head].prev = e;
+  }
+  head = e;
+}
+
+void Scheduler::unlink(uint32_t e) {
+  Entry& entry = _entries[e];
+  if (entry.prev != NONE) {
+    _entries[entry.prev].next = entry.next;
+  } else {
+    slot(entry.due) = entry.next;
+  }
+  if (entry.next != NONE) {
+    _entries[entry.next].prev = entry.prev;
+  }
+}
+
+/// take an entry out of its chunk's list and put it on the free list
+void Scheduler::release(uint32_t e) {
+  Entry& entry = _entries[e];
+  if (entry.chunk_prev != NONE) {
+    _entries[entry.chunk_prev].chunk_next = entry.chunk_next;
+  } else {
+    auto it = _chunks.find(World::toChunk(entry.position));
+    if (entry.chunk_next != NONE) {
+      it->second = entry.chunk_next;
+    } else {
+      _chunks.erase(it);
+    }
+  }
+  if (entry.chunk_next != NONE) {
+    _entries[entry.chunk_next].chunk_prev = entry.chunk_prev;
+  }
+  ++entry.generation;
+  entry.next = _free;
+  _free = e;
+  --_pending;
+}
+
+Scheduler::Handle Scheduler::schedule(glm::ivec3 p, BlockUpdate::Kind kind, uint32_t delay) {
+  assert (delay >= 1);
+  uint32_t e = _free;
+  if (e != NONE) {
+    _free = _entries[e].next;
+  } else {
+    e = _entries.size();
+    _entries.emplace_back();
+  }
+  Entry& entry = _entries[e];
+  entry.due = _now + delay;
+  entry.position = p;
+  entry.kind = kind;
+  link(e);
+
+  uint32_t& chunk_head = _chunks.try_emplace(World::toChunk(p), NONE).first->second;
+  entry.chunk_prev = NONE;
+  entry.chunk_next = chunk_head;
+  if (chunk_head != NONE) {
+    _entries[chunk_head].chunk_prev = e;
+  }
+  chunk_head = e;
+  ++_pending;
+  return {e, entry.generation};
+}
+
+bool Scheduler::cancel(Handle handle) {
+  if (handle.index >= _entries.size() || _entries[handle.index].generation != handle.generation) {
+    return false;
+  }
+  unlink(handle.index);
+  release(handle.index);
+  return true;
+}
+
+void Scheduler::advance(std::vector<BlockUpdate>& due) {
+  ++_now;
+  // a window of a higher level begins: spread its slot over the levels below, highest first,
+  // since what comes down from one level may land in the slot of the next that is opening too
+  for (int level = LEVELS - 1; level >= 1; --level) {
+    if (_now & ((uint64_t(1) << (level * SLOT_BITS)) - 1)) {
+      continue;
+    }
+    uint32_t& head = _slots[level * SLOTS + ((_now >> (level * SLOT_BITS)) & (SLOTS - 1))];
+    uint32_t e = head;
+    head = NONE;
+    while (e != NONE) {
+      uint32_t next = _entries[e].next;
+      link(e);
+      e = next;
+    }
+  }
+
+  uint32_t& head = _slots[_now & (SLOTS - 1)];
+  uint32_t e = head;
+  head = NONE;
+  while (e != NONE) {
+    uint32_t next = _entries[e].next;
+    assert (_entries[e].due == _now);
+    due.push_back({_entries[e].position, _entries[e].kind});
+    release(e);
+    e = next;
+  }
+}
+
+void Scheduler::tick(World& world) {
+  std::vector<BlockUpdate> due;
+  advance(due);
+  _last_ran = 0;
+  for (const BlockUpdate& update : due) {
+    _last_ran += run(world, update);
+  }
+
+  // random ticks, only where something reacts to them
+  constexpr uint32_t reacting = 1u << Terrain::GRASS | 1u << Terrain::DIRT;
+  for (glm::ivec2 chunk_index : world._active_set) {
+    auto it = world._chunks.find(chunk_index);
+    if (it == world._chunks.end() || it->second->_state < Chunk::State::Generated) {
+      continue;
+    }
+    for (int s = 0; s < SECTION_COUNT; ++s) {
+      if (not (it->second->_sections[s].present() & reacting)) {
+        continue;
+      }
+      uint64_t section = uint64_t(uint32_t(chunk_index.x)) << 32 ^ uint64_t(uint32_t(chunk_index.y)) << 8 ^ s;
+      for (int n = 0; n < RANDOM_TICKS_PER_SECTION; ++n) {
+        uint32_t r = mix(section, _now * RANDOM_TICKS_PER_SECTION + n);
+        glm::ivec3 p {chunk_index.x * CHUNK_SIZE + (r & 15), s * SECTION_SIZE + (r >> 4 & 15), chunk_index.y * CHUNK_SIZE + (r >> 8 & 15)};
+        _last_ran += randomTick(world, p);
+      }
+    }
+  }
+}
+
+bool Scheduler::update(World& world, double dt) {
+  _time += dt;
+  if (_time < BLOCK_TICK) {
+    return false;
+  }
+  _time = std::min(_time - BLOCK_TICK, BLOCK_TICK);
+  tick(world);
+  return true;
+}
+
+std::vector<Scheduler::Suspended> Scheduler::suspend(glm::ivec2 chunk_index) {
+  std::vector<Suspended> suspended;
+  auto it = _chunks.find(chunk_index);
+  if (it == _chunks.end()) {
+    return suspended;
+  }
+  glm::ivec3 origin {chunk_index.x * CHUNK_SIZE, 0, chunk_index.y * CHUNK_SIZE};
+  for (uint32_t e = it->second; e != NONE; ) {
+    const Entry& entry = _entries[e];
+    glm::ivec3 local = entry.position - origin;
+    suspended.push_back({uint32_t(local.x | local.z << 4 | local.y << 8), entry.kind, uint32_t(entry.due - _now)});
+    uint32_t next = entry.chunk_next;
+    unlink(e);
+    release(e);
+    e = next;
+  }
+  return suspended;
+}
+
+void Scheduler::resume(glm::ivec2 chunk_index, const std::vector<Suspended>& updates) {
+  glm::ivec3 origin {chunk_index.x * CHUNK_SIZE, 0, chunk_index.y * CHUNK_SIZE};
+  for (const Suspended& update : updates) {
+    glm::ivec3 local {int(update.local & 15), int(update.local >> 8), int(update.local >> 4 & 15)};
+    schedule(origin + local, BlockUpdate::Kind(update.kind), update.delay);
+  }
+}
+
+void Scheduler::blockChanged(const World& world, glm::ivec3 p, u_char old_block) {
+  if (old_block != Terrain::LEAF && old_block != Terrain::DIRT) {
+    return;
+  }
+  // the leaves next to it may have lost their way to a trunk. they fall a second or two later,
+  // at slightly different times, and each one that falls checks the leaves next to it
+  for (auto [x, y, z] : SIDES) {
+    glm::ivec3 n = p + glm::ivec3(x, y, z);
+    if (at(world, n, Terrain::AIR) == Terrain::LEAF) {
+      schedule(n, BlockUpdate::LEAF_DECAY, 20 + mix(key(n), _now) % 40);
+    }
+  }
+}
+
+void Scheduler::boxChanged(const World& world, Box box) {
+  // any block in box may have been a leaf or a trunk: every leaf just outside it is checked, the
+  // way blockChanged checks the leaves next to one block
+  for (int axis = 0; axis < 3; ++axis)
+  for (int side : {box.min[axis] - 1, box.max[axis]}) {
+    Box face = box;
+    face.min[axis] = side;
+    face.max[axis] = side + 1;
+    if (not world.anyOfType(face, Terrain::LEAF)) {
+      continue;
+    }
+    for (int i = face.min.x; i < face.max.x; ++i)
+    for (int j = face.min.y; j < face.max.y; ++j)
+    for (int k = face.min.z; k < face.max.z; ++k) {
+      glm::ivec3 n {i, j, k};
+      if (at(world, n, Terrain::AIR) == Terrain::LEAF) {
+        schedule(n, BlockUpdate::LEAF_DECAY, 20 + mix(key(n), _now) % 40);
+      }
+    }
+  }
+}
+
+bool Scheduler::run(World& world, const BlockUpdate& update) {
+  glm::ivec3 p = update.position;
+  switch (update.kind) {
+    case BlockUpdate::LEAF_DECAY:
+      if (at(world, p, Terrain::AIR) == Terrain::LEAF && not heldUp(world, p)) {
+        world.set(p.x, p.y, p.z, Terrain::AIR);
+        return true;
+      }
+      return false;
+  }
+  return false;
+}
+
+bool Scheduler::randomTick(World& world, glm::ivec3 p) {
+  u_char block = at(world, p, Terrain::AIR);
+  u_char above = at(world, p + glm::ivec3(0, 1, 0), Terrain::AIR);
+  // grass dies under anything opaque
+  if (block == Terrain::GRASS && Terrain::has(above, Terrain::OPAQUE)) {
+    world.set(p.x, p.y, p.z, Terrain::DIRT);
+    return true;
+  }
+  // and grows onto dirt that sees the sky next to it
+  if (block == Terrain::DIRT && above == Terrain::AIR && p.y + 1 < CHUNK_HEIGHT) {
+    glm::ivec2 chunk_index = World::toChunk(p);
+    glm::ivec3 local = World::toLocal(p);
+    u_char light = world._chunks.at(chunk_index)->light(local.x, p.y + 1, local.z);
+    if (Light::sky(light) < 9) {
+      return false;
+    }
+    for (int i = -1; i <= 1; ++i)
+    for (int j = -1; j <= 1; ++j)
+    for (int k = -1; k <= 1; ++k) {
+      if (at(world, p + glm::ivec3(i, j, k), Terrain::AIR) == Terrain::GRASS) {
+        world.set(p.x, p.y, p.z, Terrain::GRASS);
+        return true;
+      }
+    }
+  }
+  return false;
+}
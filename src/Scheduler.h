@@ -0,0 +1,113 @@
+#pragma once
+
+#include "Box.h"
+#include "Config.h"
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/gtx/hash.hpp>
+
+#include <sys/types.h>
+#include <array>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+struct World;
+
+/// something to do to one block at a later game tick
+struct BlockUpdate {
+  enum Kind : u_char {
+    LEAF_DECAY, // a leaf with no trunk within LEAF_REACH leaves of it falls
+  };
+  static constexpr int KIND_COUNT = LEAF_DECAY + 1;
+
+  glm::ivec3 position;
+  Kind kind;
+};
+
+/// block updates scheduled for later game ticks, and the random ticks every loaded section gets.
+///
+/// pending updates sit in a hierarchical timing wheel: 8 levels of 256 slots, level l holding the updates
+/// due within 256^(l+1) ticks, each slot a linked list through a pool of entries. scheduling and
+/// cancelling are O(1), and a tick looks at the one slot that is due, plus the slot of a higher level
+/// that gets spread over the levels below whenever one of its 256 tick windows begins.
+///
+/// each chunk also links its own updates together, so a chunk going to disk takes them with it and
+/// they resume with the ticks they had left once it is loaded again: nothing runs while a chunk is away
+struct Scheduler {
+  static constexpr uint32_t NONE = ~0u;
+  static constexpr int SLOT_BITS = 8;
+  static constexpr int SLOTS = 1 << SLOT_BITS;
+  static constexpr int LEVELS = 64 / SLOT_BITS;
+
+  /// names a scheduled update for cancel. stays safe to use after the update ran or was cancelled
+  struct Handle {
+    uint32_t index = NONE;
+    uint32_t generation = 0;
+  };
+
+  /// an update of a chunk that is on disk: position in the chunk, kind and ticks it had left
+  struct Suspended {
+    uint32_t local;
+    u_char kind;
+    uint32_t delay;
+  };
+
+  struct Entry {
+    uint64_t due;
+    glm::ivec3 position;
+    BlockUpdate::Kind kind;
+    uint32_t generation = 0;
+    uint32_t prev, next;             // in the wheel slot, or the free list
+    uint32_t chunk_prev, chunk_next; // in the chunk's list
+  };
+
+  std::vector<Entry> _entries;
+  uint32_t _free = NONE;
+  std::array<uint32_t, LEVELS * SLOTS> _slots; // first entry of every slot
+  std::unordered_map<glm::ivec2, uint32_t> _chunks; // first entry of every chunk with updates pending
+  uint64_t _now = 0;
+  double _time = 0; // seconds not simulated yet
+  size_t _pending = 0;
+  size_t _last_ran = 0; // updates and random ticks that did anything in the last tick
+
+  Scheduler() { _slots.fill(NONE); }
+
+  /// run kind on the block at p delay ticks from now, delay >= 1
+  Handle schedule(glm::ivec3 p, BlockUpdate::Kind kind, uint32_t delay);
+
+  /// forget an update that has not run yet. false if it already ran or was cancelled
+  bool cancel(Handle handle);
+
+  /// move to the next tick and append the updates due at it
+  void advance(std::vector<BlockUpdate>& due);
+
+  /// one game tick: run the updates due, then the random ticks around the player
+  void tick(World& world);
+
+  /// time passed: run a tick if one is due, at most one per call
+  bool update(World& world, double dt);
+
+  /// take the updates of a chunk out of the wheel before it is evicted
+  std::vector<Suspended> suspend(glm::ivec2 chunk_index);
+
+  /// put them back when it is loaded again
+  void resume(glm::ivec2 chunk_index, const std::vector<Suspended>& updates);
+
+  /// a block at p changed from old_block: schedule whatever around it may react
+  void blockChanged(const World& world, glm::ivec3 p, u_char old_block);
+
+  /// blocks anywhere in box may have changed: the same for the leaves on its faces
+  void boxChanged(const World& world, Box box);
+
+  /// do an update, or a random tick of the block at p
+  static bool run(World& world, const BlockUpdate& update);
+  static bool randomTick(World& world, glm::ivec3 p);
+
+private:
+  uint32_t& slot(uint64_t due);
+  void link(uint32_t e);
+  void unlink(uint32_t e);
+  void release(uint32_t e);
+};
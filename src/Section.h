@@ -0,0 +1,313 @@
+#pragma once
+
+#include "Config.h"
+#include "Terrain.h"
+#include "Pool.h"
+#include "Layout.h"
+#include "Box.h"
+
+#include <sys/types.h>
+
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <algorithm>
+
+/// a 16^3 slice of a chunk's column.
+/// uniform sections (all air, all stone, all water) point at a shared read-only singleton
+/// and only get storage of their own on the first write that changes them.
+///
+/// next to the blocks every section keeps bit-packed opaque and liquid masks from the block registry,
+/// one 16 bit row per (y, z) with bit x set, so face and collision queries are shifts and ands,
+/// and a count of every block type, so spatial queries can skip sections without the type they want.
+///
+/// copying a Section shares its storage: storage is reference counted and copied on write,
+/// so a snapshot handed to a worker never changes underneath it. edits swap in a fresh copy
+/// and the worker's reference keeps the old one alive until it lets go.
+struct Section {
+  static constexpr int VOLUME = SECTION_SIZE * SECTION_SIZE * SECTION_SIZE;
+  using Blocks = std::array<u_char, VOLUME>;
+  using Rows = std::array<uint16_t, SECTION_SIZE * SECTION_SIZE>;
+  using Counts = std::array<uint16_t, Terrain::BLOCK_COUNT>;
+
+  struct Storage {
+    Blocks blocks;
+    Rows opaque; // Terrain::OPAQUE blocks
+    Rows liquid; // Terrain::LIQUID blocks
+    Counts counts; // voxels of each block id
+    std::atomic<int> refs {1};
+
+    Storage() = default;
+    Storage(const Storage& o): blocks(o.blocks), opaque(o.opaque), liquid(o.liquid), counts(o.counts) {}
+  };
+
+  using Pool = SlabPool<Storage, 2 * 1024 * 1024>;
+
+  Storage* _data = shared(Terrain::AIR);
+  bool _owned = false;
+
+  Section() = default;
+  Section(const Section& o): _data(o._data), _owned(o._owned) { retain(); }
+  Section(Section&& o): _data(o._data), _owned(o._owned) { o._data = shared(Terrain::AIR); o._owned = false; }
+  Section& operator=(const Section& o) {
+    if (this != &o) {
+      release();
+      _data = o._data;
+      _owned = o._owned;
+      retain();
+    }
+    return *this;
+  }
+  Section& operator=(Section&& o) {
+    std::swap(_data, o._data);
+    std::swap(_owned, o._owned);
+    return *this;
+  }
+  ~Section() { release(); }
+
+  /// the singleton for sections made up entirely of block, or nullptr if that block has none
+  static Storage* shared(u_char block) {
+    static Storage air   = filled(Terrain::AIR);
+    static Storage stone = filled(Terrain::STONE);
+    static Storage water = filled(Terrain::WATER);
+    switch (block) {
+      case Terrain::AIR:   return &air;
+      case Terrain::STONE: return &stone;
+      case Terrain::WATER: return &water;
+    }
+    return nullptr;
+  }
+
+  /// storage for every section that holds its own blocks
+  static Pool& pool() {
+    static Pool pool;
+    return pool;
+  }
+
+  /// where voxel (i, j, k) lives in blocks, see Layout.h
+  static int index(int i, int j, int k) {
+    assert (i >= 0 && i < SECTION_SIZE && j >= 0 && j < SECTION_SIZE && k >= 0 && k < SECTION_SIZE);
+    return VoxelLayout::index(i, j, k);
+  }
+
+  static int row(int j, int k) {
+    return j * SECTION_SIZE + k;
+  }
+
+  static bool isOpaque(u_char block) { return Terrain::has(block, Terrain::OPAQUE); }
+  static bool isLiquid(u_char block) { return Terrain::has(block, Terrain::LIQUID); }
+
+  u_char get(int i, int j, int k) const {
+    return _data->blocks[index(i, j, k)];
+  }
+
+  /// how many voxels are block
+  int count(u_char block) const {
+    assert (block < Terrain::BLOCK_COUNT);
+    return _data->counts[block];
+  }
+
+  /// the block ids this section holds, bit b for block b
+  uint32_t present() const {
+    uint32_t present = 0;
+    for (int b = 0; b < Terrain::BLOCK_COUNT; ++b) {
+      present |= (_data->counts[b] != 0) << b;
+    }
+    return present;
+  }
+
+  /// bit j set if layer j holds anything but air
+  uint16_t layers() const {
+    uint16_t layers = 0;
+    for (int j = 0; j < SECTION_SIZE; ++j) {
+      uint16_t any = 0;
+      for (int k = 0; k < SECTION_SIZE; ++k) {
+        any |= _data->opaque[row(j, k)] | _data->liquid[row(j, k)];
+      }
+      layers |= (any != 0) << j;
+    }
+    return layers;
+  }
+
+  uint16_t opaqueRow(int j, int k) const { return _data->opaque[row(j, k)]; }
+  uint16_t liquidRow(int j, int k) const { return _data->liquid[row(j, k)]; }
+
+  bool isAir(int i, int j, int k) const {
+    return not (((_data->opaque[row(j, k)] | _data->liquid[row(j, k)]) >> i) & 1);
+  }
+
+  void set(int i, int j, int k, u_char block) {
+    int idx = index(i, j, k);
+    if (_data->blocks[idx] == block) {
+      return;
+    }
+    assert (block < Terrain::BLOCK_COUNT);
+    makeWritable();
+    _data->counts[_data->blocks[idx]]--;
+    _data->counts[block]++;
+    _data->blocks[idx] = block;
+
+    uint16_t bit = 1 << i;
+    int r = row(j, k);
+    _data->opaque[r] = (_data->opaque[r] & ~bit) | (isOpaque(block) ? bit : 0);
+    _data->liquid[r] = (_data->liquid[r] & ~bit) | (isLiquid(block) ? bit : 0);
+  }
+
+  /// set blocks i0 <= i < i1 of row (j, k), the masks take the whole run at once. false if the run held
+  /// block already
+  bool fillRun(int i0, int i1, int j, int k, u_char block) {
+    if (i0 >= i1 || (not _owned && uniformBlock() == block)) {
+      return false;
+    }
+    int first = i0;
+    while (first < i1 && _data->blocks[index(first, j, k)] == block) {
+      ++first;
+    }
+    if (first == i1) {
+      return false;
+    }
+    assert (block < Terrain::BLOCK_COUNT);
+    makeWritable();
+    for (int i = i0; i < i1; ++i) {
+      u_char& b = _data->blocks[index(i, j, k)];
+      _data->counts[b]--;
+      b = block;
+    }
+    _data->counts[block] += i1 - i0;
+
+    uint16_t bits = uint16_t(((1u << i1) - 1) & ~((1u << i0) - 1));
+    int r = row(j, k);
+    _data->opaque[r] = (_data->opaque[r] & ~bits) | (isOpaque(block) ? bits : 0);
+    _data->liquid[r] = (_data->liquid[r] & ~bits) | (isLiquid(block) ? bits : 0);
+    return true;
+  }
+
+  /// turn every from inside part, in section coordinates, into to. the masks and counts are rebuilt once at
+  /// the end. false if part held no from
+  bool replace(const Box& part, u_char from, u_char to) {
+    if (from == to || (not _owned && uniformBlock() != from)) {
+      return false;
+    }
+    bool hit = false;
+    for (int i = part.min.x; i < part.max.x; ++i)
+    for (int j = part.min.y; j < part.max.y; ++j)
+    for (int k = part.min.z; k < part.max.z; ++k) {
+      int idx = index(i, j, k);
+      if (_data->blocks[idx] == from) {
+        if (not hit) {
+          makeWritable();
+          hit = true;
+        }
+        _data->blocks[idx] = to;
+      }
+    }
+    if (hit) {
+      updateSummary(*_data);
+      compact();
+    }
+    return hit;
+  }
+
+  /// replace every voxel with block
+  void fill(u_char block) {
+    release();
+    _data = shared(block);
+    if (_data == nullptr) {
+      _data = pool().create(filled(block));
+      _owned = true;
+    }
+  }
+
+  /// replace every voxel with a copy of blocks
+  void assign(const Blocks& blocks) {
+    if (not _owned || shares()) {
+      release();
+      _data = pool().create();
+      _owned = true;
+    }
+    _data->blocks = blocks;
+    updateSummary(*_data);
+    compact();
+  }
+
+  /// true if every voxel is the same block and no storage is held
+  bool uniform() const { return not _owned; }
+
+  /// true if every voxel is block
+  bool only(u_char block) const { return count(block) == VOLUME; }
+
+  /// only meaningful when uniform()
+  u_char uniformBlock() const { return _data->blocks[0]; }
+
+  /// give storage back if a generation pass or edit left this section uniform
+  void compact() {
+    if (not _owned) {
+      return;
+    }
+    const Blocks& blocks = _data->blocks;
+    u_char first = blocks[0];
+    Storage* singleton = shared(first);
+    if (singleton && std::all_of(blocks.begin(), blocks.end(), [first](u_char b) { return b == first; })) {
+      release();
+      _data = singleton;
+    }
+  }
+
+  size_t bytes() const { return _owned ? sizeof(Storage) : 0; }
+
+  /// another Section (a snapshot) is holding on to this storage
+  bool shares() const {
+    return _owned && _data->refs.load(std::memory_order_acquire) > 1;
+  }
+
+private:
+  /// copy on write: singletons and storage a snapshot still reads get replaced by a private copy
+  void makeWritable() {
+    if (not _owned || shares()) {
+      Storage* copy = pool().create(*_data);
+      release();
+      _data = copy;
+      _owned = true;
+    }
+  }
+
+  void retain() {
+    if (_owned) {
+      _data->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  static void updateSummary(Storage& storage) {
+    storage.opaque.fill(0);
+    storage.liquid.fill(0);
+    storage.counts.fill(0);
+    for (int i = 0; i < SECTION_SIZE; ++i)
+    for (int j = 0; j < SECTION_SIZE; ++j)
+    for (int k = 0; k < SECTION_SIZE; ++k) {
+      u_char block = storage.blocks[index(i, j, k)];
+      assert (block < Terrain::BLOCK_COUNT);
+      storage.opaque[row(j, k)] |= (isOpaque(block) ? 1 : 0) << i;
+      storage.liquid[row(j, k)] |= (isLiquid(block) ? 1 : 0) << i;
+      storage.counts[block]++;
+    }
+  }
+
+  static Storage filled(u_char block) {
+    assert (block < Terrain::BLOCK_COUNT);
+    Storage storage;
+    storage.blocks.fill(block);
+    storage.opaque.fill(isOpaque(block) ? 0xFFFF : 0);
+    storage.liquid.fill(isLiquid(block) ? 0xFFFF : 0);
+    storage.counts.fill(0);
+    storage.counts[block] = VOLUME;
+    return storage;
+  }
+
+  void release() {
+    if (_owned && _data->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      pool().destroy(_data);
+    }
+    _owned = false;
+  }
+};
@@ -9,19 +9,24 @@ R"zzz(#version 410 core
 // input from render
 layout (location = 0) in vec4 vertex_position;
 
-// input from instances
-layout (location = 1) in vec3 instance_offset;
-layout (location = 2) in uint direction;
-layout (location = 3) in uint texture_index;
+// input from instances, packed as in Instance
+layout (location = 1) in uint face;  // x | z << 4 | y << 8 | direction << 17 | block << 20
+layout (location = 2) in uint shade; // light | (width - 1) << 8 | (height - 1) << 12
 
-uniform mat4 light_space;
+// the first block of the chunk being drawn, in x and z
+uniform ivec2 chunk_origin;
 
 out uint vs_direction;
 out uint vs_texture_index;
-out vec4 vs_light_space_position;
+out uint vs_light;
 
 void main()
 {
+  vec3 instance_offset = vec3(chunk_origin.x + int(face & 15u), (face >> 8) & 511u, chunk_origin.y + int((face >> 4) & 15u));
+  uint direction = (face >> 17) & 7u;
+  uint texture_index = face >> 20;
+  uint light = shade & 255u;
+
   vec3 pos = vertex_position.xyz;
   switch(direction) {
     case 0: // +X
@@ -42,10 +47,17 @@ void main()
       pos.x *= -1;
       break;
   }
+  // stretch the unit face over the rectangle, keeping its near corner where it was
+  vec3 size = vec3(1);
+  uint n = direction % 3u;
+  size[(n + 1u) % 3u] = float(((shade >> 8) & 15u) + 1u);
+  size[(n + 2u) % 3u] = float(((shade >> 12) & 15u) + 1u);
+  pos = (pos + 0.5) * size - 0.5;
+
   vs_direction = direction;
   vs_texture_index = texture_index;
+  vs_light = light;
 	gl_Position = vec4(instance_offset, 0) + vec4(pos, 1);
-  vs_light_space_position = light_space * gl_Position;
 }
 )zzz";
 
@@ -63,11 +75,12 @@ uniform mat4 view;
 // input from vertex shader
 in uint vs_direction[];
 in uint vs_texture_index[];
-in vec4 vs_light_space_position[];
+in uint vs_light[];
 
 // pass along from vertex shader
 flat out uint sq_direction;
 flat out uint sq_texture_index;
+flat out uint sq_light;
 
 // output to fragment shader
 flat out vec4 normal;
@@ -76,12 +89,12 @@ flat out float perimeter;
 out vec2 tex_coord;
 
 out vec4 world_position;
-out vec4 light_space_position;
 
 void main()
 {
   sq_direction = vs_direction[0];
   sq_texture_index = vs_texture_index[0];
+  sq_light = vs_light[0];
   
 	vec3 AB = gl_in[1].gl_Position.xyz - gl_in[0].gl_Position.xyz;
 	vec3 AC = gl_in[2].gl_Position.xyz - gl_in[0].gl_Position.xyz;
@@ -95,28 +108,24 @@ void main()
 	perimeter = length(A - B) + length(B - C) + length(C - A);
 	
   world_position = vec4(A, 1);
-  light_space_position = vs_light_space_position[0];
   gl_Position = projection * view * world_position;
   bary_coord = vec4(1, 0, 0, 0);
   tex_coord = vec2(0, 0);
   EmitVertex();
 
   world_position = vec4(D, 1);
-  light_space_position = vs_light_space_position[0] + (vs_light_space_position[2] - vs_light_space_position[1]);
   gl_Position = projection * view * world_position;
   bary_coord = vec4(0, 0, 0, 1);
   tex_coord = vec2(0, 1);
   EmitVertex();
 
   world_position = vec4(B, 1);
-  light_space_position = vs_light_space_position[1];
   gl_Position = projection * view * world_position;
   bary_coord = vec4(0, 1, 0, 0);
   tex_coord = vec2(1, 0);
   EmitVertex();
 
   world_position = vec4(C, 1);
-  light_space_position = vs_light_space_position[2];
   gl_Position = projection * view * world_position;
   bary_coord = vec4(0, 0, 1, 0);
   tex_coord = vec2(1, 1);
@@ -133,14 +142,14 @@ R"zzz(#version 410 core
 uniform bool wireframe; 
 uniform vec4 light_position;
 
-uniform vec4 base_colors[10];
-uniform vec4 off_colors[10];
-
-uniform sampler2D shadowMap;
+uniform vec4 base_colors[16]; // Terrain::SHADER_BLOCK_SLOTS
+uniform vec4 off_colors[16];
+uniform uint liquids;         // bit b set if block b is a liquid
 
 // input from vertex shader passed through geometry shader
 flat in uint sq_direction;
 flat in uint sq_texture_index;
+flat in uint sq_light;        // Light of the voxel in front of the face: sky << 4 | block
 
 flat in vec4 normal;
 in vec4 bary_coord;
@@ -149,43 +158,15 @@ in vec2 tex_coord;
 flat in vec3 flag_color;
 
 in vec4 world_position;
-in vec4 light_space_position;
 
 out vec4 fragment_color;
 
-float calculateShadow() {
-  // divide by homogeneous component
-  vec3 proj_pos = light_space_position.xyz / light_space_position.w;
-
-  // [-1, 1] -> [0, 1]
-  proj_pos = proj_pos * 0.5 + 0.5;
-         
-  float closest_to_light_d = texture(shadowMap, proj_pos.xy).r;
-
-  float closest_to_camera_d = proj_pos.z;
-
-  vec4 light_dir = normalize(world_position - light_position);
-  // float bias = max(0.05 * (1.0 - dot(normal, light_dir)), 0.005);
-  float bias = 0.003;
-
-  float shadow = 0.0;
-  vec2 texelSize = 1.0 / textureSize(shadowMap, 0);
-  for(int x = -1; x <= 1; ++x) {
-    for(int y = -1; y <= 1; ++y) {
-      float pcf_d = texture(shadowMap, proj_pos.xy + vec2(x, y) * texelSize).r; 
-      shadow += closest_to_camera_d - bias > pcf_d ? 1.0 : 0.0;        
-    }
-  }
-  shadow /= 9.0;
-  
-  // keep the shadow at 0.0 when outside the far_plane region of the light's frustum.
-  if(proj_pos.z > 1.0)
-    shadow = 0.0;
-
-  return shadow;
+// each level darker than full light is 80% as bright
+float light_level() {
+  float level = max(float(sq_light >> 4), float(sq_light & 15u));
+  return pow(0.8, 15 - level);
 }
 
-
 float rand(vec2 co){
   return fract(sin(dot(co.xy, vec2(12.9898,78.233))) * 49.5428);
 }
@@ -226,7 +207,6 @@ float ProceduralNoise(float u, float v) {
 }
 
 float TWO_PI = 6.28318530717958647692528676655900576;
-#define WATER 3
 
 vec3 get_gradient(int i, int j, int k) {
   float theta = rand(vec2(i, j));
@@ -353,22 +333,11 @@ void main()
   fragment_color = height_atten(fragment_color);
 	
   fragment_color = menger_color(fragment_color);
-  if (sq_texture_index == WATER) fragment_color =vec4(.75f,.75f,.75f,1) * vec4(0.05f,0.2f,.7f,.6f); //FIXME: water should be see-through
-  // if (sq_texture_index == WATER) fragment_color.w = 1;
+  if (((liquids >> sq_texture_index) & 1u) != 0u) fragment_color =vec4(.75f,.75f,.75f,1) * vec4(0.05f,0.2f,.7f,.6f); //FIXME: water should be see-through
+  // if (((liquids >> sq_texture_index) & 1u) != 0u) fragment_color.w = 1;
   else fragment_color.w = 1;
 
-  if (light_space_position.w != 0) {
-
-    float shadow_ratio = calculateShadow();
-    vec4 shadow_color = mix(vec4(0, 0, 0, 1), fragment_color, 1 - shadow_ratio);
-    fragment_color = mix(shadow_color, fragment_color, shadow_ratio > 0.5 ? 0.5 : 1);
-    float depth = gl_FragCoord.z;
-    
-    // depth = clamp((depth - 0.99) * 100, 0, 1);
-    // fragment_color = mix(vec4(0.5, 0.5, 0.5, 1), fragment_color, 1 - depth);
-  } else {
-    // fragment_color = vec4(gl_FragCoord.zzz, 1);
-  }  
+  fragment_color.rgb *= light_level();
 
   if (wireframe) {
     bool is_frame = min(bary_coord.x, min(bary_coord.y, bary_coord.z)) * perimeter < 0.05;
@@ -1,33 +1,23 @@
 #include "Terrain.h"
 
 void Terrain::setColors(std::vector<glm::vec4>& base_colors, std::vector<glm::vec4>& off_colors) {
-  base_colors[AIR]   = glm::vec4(0);
-  base_colors[GRASS] = glm::vec4(0.2, 0.8, 0, 1);
-  base_colors[STONE] = glm::vec4(0.5, 0.5, 0.5, 1);
-  base_colors[WATER] = glm::vec4(0, 0, 1, 1);
-  base_colors[DIRT]  = glm::vec4(0.5, 0.3, 0, 1);
-  base_colors[LEAF]  = glm::vec4(0.0, 0.2, 0, 1);
-
-  off_colors[AIR]   = glm::vec4(0);
-  off_colors[GRASS] = glm::vec4(0, 0.6, 0, 1);
-  off_colors[STONE] = glm::vec4(0.2, 0.2, 0.2, 1);
-  off_colors[WATER] = glm::vec4(0, 0.5, .8, 1);
-  off_colors[DIRT]  = glm::vec4(0.3, 0.1, 0, 1);
-  off_colors[LEAF]  = glm::vec4(0.1, 0.3, 0, 1);
+  base_colors.assign(BLOCK_COUNT, glm::vec4(0));
+  off_colors.assign(BLOCK_COUNT, glm::vec4(0));
+  for (int b = 0; b < BLOCK_COUNT; ++b) {
+    const Color& base = BLOCKS[b].base_color;
+    const Color& off = BLOCKS[b].off_color;
+    base_colors[b] = glm::vec4(base.r, base.g, base.b, base.a);
+    off_colors[b]  = glm::vec4(off.r, off.g, off.b, off.a);
+  }
 }
 
 std::string Terrain::_str(Terrain::TerrainEnum t) {
-  switch(t) {
-  case AIR:   return "Air";
-  case GRASS: return "Grass";
-  case STONE: return "Stone";
-  case WATER: return "Water";
-  case DIRT:  return "Dirt";
-  case LEAF:  return "Leaf";
-  default:    return "UNKNOWN BLOCK";
+  if (t >= 0 && t < BLOCK_COUNT) {
+    return BLOCKS[t].name;
   }
+  return "UNKNOWN BLOCK";
 }
 
 std::string Terrain::str(u_char byte) {
   return Terrain::_str(static_cast<TerrainEnum>(byte));
-}
\ No newline at end of file
+}
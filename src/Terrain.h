@@ -1,16 +1,130 @@
 #pragma once
 #include <glm/glm.hpp>
+#include <sys/types.h>
+#include <array>
+#include <cstdint>
 #include <vector>
 #include <string>
 
 namespace Terrain {
   enum TerrainEnum : int {
-    AIR = 0, GRASS = 1, STONE = 2, WATER = 3, DIRT = 4, LEAF = 5
+    AIR = 0, GRASS = 1, STONE = 2, WATER = 3, DIRT = 4, LEAF = 5, LAMP = 6,
+    FLOW_1 = 7, FLOW_2 = 8, FLOW_3 = 9, FLOW_4 = 10, FLOW_5 = 11, FLOW_6 = 12, FLOW_7 = 13
   };
 
+  /// what a block is, one bit each. hot paths test these through PROPERTIES, never by block id
+  enum Property : uint8_t {
+    OPAQUE      = 1 << 0, // hides the faces of whatever is behind it
+    SOLID       = 1 << 1, // collides with the player
+    TRANSPARENT = 1 << 2, // light and the view pass through
+    LIQUID      = 1 << 3, // flows, drawn in the water pass
+  };
+
+  struct Color { float r, g, b, a; };
+
+  struct BlockInfo {
+    const char* name;
+    uint8_t properties;
+    uint8_t light;      // block light it gives off, 0 .. 15
+    uint8_t level;      // liquids: how full, SOURCE_LEVEL for water that never drains, see Water
+    Color base_color;
+    Color off_color;
+  };
+
+  /// the block registry, indexed by block id. adding a block is adding a row here
+  constexpr std::array<BlockInfo, 14> BLOCKS {{
+    /* AIR    */ {"Air",     TRANSPARENT,                0, 0, {0, 0, 0, 0},         {0, 0, 0, 0}},
+    /* GRASS  */ {"Grass",   OPAQUE | SOLID,             0, 0, {0.2, 0.8, 0, 1},     {0, 0.6, 0, 1}},
+    /* STONE  */ {"Stone",   OPAQUE | SOLID,             0, 0, {0.5, 0.5, 0.5, 1},   {0.2, 0.2, 0.2, 1}},
+    /* WATER  */ {"Water",   TRANSPARENT | LIQUID,       0, 8, {0, 0, 1, 1},         {0, 0.5, 0.8, 1}},
+    /* DIRT   */ {"Dirt",    OPAQUE | SOLID,             0, 0, {0.5, 0.3, 0, 1},     {0.3, 0.1, 0, 1}},
+    /* LEAF   */ {"Leaf",    OPAQUE | SOLID,             0, 0, {0.0, 0.2, 0, 1},     {0.1, 0.3, 0, 1}},
+    /* LAMP   */ {"Lamp",    OPAQUE | SOLID,            14, 0, {1.0, 0.9, 0.6, 1},   {0.9, 0.7, 0.3, 1}},
+    /* FLOW_1 */ {"Flow 1",  TRANSPARENT | LIQUID,       0, 1, {0, 0.1, 1, 1},       {0, 0.5, 0.8, 1}},
+    /* FLOW_2 */ {"Flow 2",  TRANSPARENT | LIQUID,       0, 2, {0, 0.1, 1, 1},       {0, 0.5, 0.8, 1}},
+    /* FLOW_3 */ {"Flow 3",  TRANSPARENT | LIQUID,       0, 3, {0, 0.1, 1, 1},       {0, 0.5, 0.8, 1}},
+    /* FLOW_4 */ {"Flow 4",  TRANSPARENT | LIQUID,       0, 4, {0, 0.1, 1, 1},       {0, 0.5, 0.8, 1}},
+    /* FLOW_5 */ {"Flow 5",  TRANSPARENT | LIQUID,       0, 5, {0, 0.1, 1, 1},       {0, 0.5, 0.8, 1}},
+    /* FLOW_6 */ {"Flow 6",  TRANSPARENT | LIQUID,       0, 6, {0, 0.1, 1, 1},       {0, 0.5, 0.8, 1}},
+    /* FLOW_7 */ {"Flow 7",  TRANSPARENT | LIQUID,       0, 7, {0, 0.1, 1, 1},       {0, 0.5, 0.8, 1}},
+  }};
+
+  constexpr int BLOCK_COUNT = BLOCKS.size();
+
+  /// the world shader's colour tables hold this many blocks
+  constexpr int SHADER_BLOCK_SLOTS = 16;
+  static_assert(BLOCK_COUNT <= SHADER_BLOCK_SLOTS, "grow the colour arrays in the world fragment shader");
+
+  /// properties of every byte value, so a lookup never needs a bounds check. unknown ids have none
+  constexpr std::array<uint8_t, 256> PROPERTIES = [] {
+    std::array<uint8_t, 256> properties {};
+    for (int b = 0; b < BLOCK_COUNT; ++b) {
+      properties[b] = BLOCKS[b].properties;
+    }
+    return properties;
+  }();
+
+  constexpr bool has(u_char block, Property property) {
+    return PROPERTIES[block] & property;
+  }
+
+  /// block light given off by every byte value, unknown ids give none
+  constexpr std::array<uint8_t, 256> EMISSION = [] {
+    std::array<uint8_t, 256> emission {};
+    for (int b = 0; b < BLOCK_COUNT; ++b) {
+      emission[b] = BLOCKS[b].light;
+    }
+    return emission;
+  }();
+
+  /// water that is not flowing anywhere, everything it feeds is one level lower
+  constexpr int SOURCE_LEVEL = 8;
+
+  /// liquid level of every byte value, 0 for anything that is not a liquid
+  constexpr std::array<uint8_t, 256> LEVEL = [] {
+    std::array<uint8_t, 256> level {};
+    for (int b = 0; b < BLOCK_COUNT; ++b) {
+      level[b] = BLOCKS[b].level;
+    }
+    return level;
+  }();
+
+  /// the flowing water block at level 1 .. SOURCE_LEVEL - 1
+  constexpr u_char flowing(int level) {
+    return u_char(FLOW_1 + level - 1);
+  }
+
+  static_assert(LEVEL[WATER] == SOURCE_LEVEL, "water is a source");
+  static_assert(LEVEL[flowing(1)] == 1 && LEVEL[flowing(SOURCE_LEVEL - 1)] == SOURCE_LEVEL - 1, "one flowing block per level");
+
+  /// blocks with a property as a bitmask over block ids, for the shader
+  constexpr uint32_t mask(Property property) {
+    uint32_t mask = 0;
+    for (int b = 0; b < BLOCK_COUNT; ++b) {
+      mask |= (BLOCKS[b].properties & property) ? 1u << b : 0;
+    }
+    return mask;
+  }
+
+  /// the mesher keeps one mask of opaque blocks and one of liquids, and culls liquid against liquid:
+  /// every block but air is in exactly one mask
+  constexpr bool meshable() {
+    for (int b = 1; b < BLOCK_COUNT; ++b) {
+      bool opaque = BLOCKS[b].properties & OPAQUE;
+      bool liquid = BLOCKS[b].properties & LIQUID;
+      if (opaque == liquid) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  static_assert(PROPERTIES[AIR] == TRANSPARENT, "air is nothing");
+  static_assert(meshable(), "a block the opaque and liquid masks cannot draw");
+
   void setColors(std::vector<glm::vec4>& base_colors, std::vector<glm::vec4>& off_colors);
 
   std::string _str(TerrainEnum t);
 
   std::string str(u_char byte);
-}
\ No newline at end of file
+}
@@ -9,11 +9,12 @@
 
 #include <iostream>
 #include <unordered_set>
+#include <random>
 
 // FIXME: is every chunk actually only loaded once?
 
-static std::unordered_set<glm::ivec3> cave_voxels_to_be_carved;
-// std::unordered_map<glm::ivec2, std::unordered_set<glm::ivec3>> cave_voxels_to_be_carved;
+// every pass below writes to its own chunk only and depends on nothing but the chunk index,
+// so a chunk that is evicted unmodified and generated again comes back block for block the same
 
 void TerrainGen::spawn(World& world, Player& player) {
   auto chunk_index = World::toChunk(player.blockPosition());
@@ -21,19 +22,18 @@ void TerrainGen::spawn(World& world, Player& player) {
   for (int i = -RENDER_DISTANCE; i <= RENDER_DISTANCE; ++i) {
     for (int k = -RENDER_DISTANCE; k <= RENDER_DISTANCE; ++k) {
       glm::ivec2 curr_index = chunk_index + glm::ivec2(i, k);
-      world._chunks.emplace(curr_index, new Chunk());
-      chunk(world, curr_index);
+      if (not world.hasChunk(curr_index)) {
+        world.create(curr_index);
+      }
+      if (world.chunk(curr_index)->_state < Chunk::State::Generated) {
+        chunk(world, curr_index);
+      }
     }
   }
 }
 
-void TerrainGen::ground(Chunk* chunk, glm::ivec2 chunk_index) {
-  assert(chunk->_state == Chunk::State::Exists);
-  int bi = chunk_index.x * CHUNK_SIZE;
-  int bk = chunk_index.y * CHUNK_SIZE;
-
-  /// Base generation pass
-
+/// the ground of the column at i, k, bottom up: what the ground pass puts there before caves and trees
+static void groundColumn(int i, int k, std::array<u_char, CHUNK_HEIGHT>& blocks) {
   auto stretch_octave = [](int s) {
     using namespace Terrain;
     if (s < 2) return GRASS;
@@ -41,55 +41,82 @@ void TerrainGen::ground(Chunk* chunk, glm::ivec2 chunk_index) {
     return STONE;
   };
 
-  // FIXME: check: is everything in this function actually in the same chunk?
-
-  for (int di = 0; di < CHUNK_SIZE; ++di)
-  for (int dk = 0; dk < CHUNK_SIZE; ++dk)
-  {
-    int i = bi + di;
-    int k = bk + dk;
+  // solidity of block
+  bool solid[CHUNK_HEIGHT] = {}; // all elements zero
 
-    // solidity of block
-    bool column[128] = {}; // all elements zero
+  // (2 + p2) - y/64 <= 0 from y = 192 up, so taller worlds don't need noise up there
+  for (int y = 0; y < glm::min(CHUNK_HEIGHT, 192); ++y) {
+    if (not solid[y]) {
 
-    for (int y = 0; y < 128; ++y) {
-      if (not column[y]) {
+      // float gradient =  1 + 1/p2 - y/64.f;
+      float p2 = perlin(i / 150.f, 0, k / 150.f);
+      float p = perlin(i / 150.f, y / 128.f, k / 150.f);
 
-        // float gradient =  1 + 1/p2 - y/64.f;
-        float p2 = perlin(i / 150.f, 0, k / 150.f);
-        float p = perlin(i / 150.f, y / 128.f, k / 150.f);
+      float scalefac = .4f + .4f * p2;
+      float gradient = (2 + p2) - y/64.f;
 
-        float scalefac = .4f + .4f * p2;
-        float gradient = (2 + p2) - y/64.f;
+      // any nonzero floor is ground, -1 too, as it always was up to y = 128. above that, in taller worlds,
+      // the gradient only goes further negative, and a -1 there has to read as air or the sky fills up
+      float v = glm::floor(glm::mix(gradient, p, scalefac));
+      solid[y] = y < 128 ? v != 0 : v >= 1;
+    }
+  }
 
-        column[y] = glm::floor(glm::mix(gradient, p, scalefac));
+  int stretch = 0;
+  bool seen = false;
+  for (int j = CHUNK_HEIGHT - 1; j >= 0; --j) {
+    if (solid[j]) {
+      seen = true;
+      blocks[j] = stretch_octave(stretch);
+      stretch ++;
+    } else {
+      if (seen) {
+        stretch = 2;
+      } else {
+        stretch = 0;
       }
+      blocks[j] = j < 40 ? Terrain::WATER : Terrain::AIR;
     }
-    
-    int stretch = 0;
-    bool seen = false;
-    for (int j = 127; j >= 0; --j) {
-      if (column[j]) {
-        seen = true;
-        chunk->data.at(di).at(j).at(dk) = stretch_octave(stretch);
-        stretch ++;
-      } else {
-        if (seen) {
-          stretch = 2;
-        } else {
-          stretch = 0;
-        }
-        if (j < 40) {
-          chunk->data.at(di).at(j).at(dk) = Terrain::WATER;
-        }
+  }
+}
+
+void TerrainGen::ground(Column& column, glm::ivec2 chunk_index) {
+  int bi = chunk_index.x * CHUNK_SIZE;
+  int bk = chunk_index.y * CHUNK_SIZE;
+
+  /// Base generation pass
+
+  std::array<u_char, CHUNK_HEIGHT> blocks;
+  for (int di = 0; di < CHUNK_SIZE; ++di)
+  for (int dk = 0; dk < CHUNK_SIZE; ++dk)
+  {
+    groundColumn(bi + di, bk + dk, blocks);
+    for (int j = 0; j < CHUNK_HEIGHT; ++j) {
+      if (blocks[j] != Terrain::AIR) {
+        column.set(di, j, dk, blocks[j]);
       }
     }
   }
 
-  chunk->_state = Chunk::State::Generated_Ground;
+  // air above the terrain and stone below it go back to the shared sections
+  column.compact();
 }
 
-std::unordered_set<glm::ivec3> TerrainGen::carve_set(glm::ivec2 chunk_index) {
+constexpr int CAVE_RADIUS = 5;
+// a cave starts within a chunk or so of its own and walks 19 steps of 3 blocks, carving balls of
+// radius 5 on the way, so every ball stays within 5 chunks of where it started
+constexpr int CAVE_REACH = 5;
+
+/// whether a chunk starts a cave of its own
+static bool hasCave(glm::ivec2 chunk_index) {
+  int bi = chunk_index.x * CHUNK_SIZE;
+  int bk = chunk_index.y * CHUNK_SIZE;
+  // don't carve as many caves
+  return perlin(bi/15.f, bk/15.f) < 0.2;
+}
+
+/// centres of the balls the cave starting in chunk_index is carved with
+static std::vector<glm::vec3> caveBalls(glm::ivec2 chunk_index) {
   int bi = chunk_index.x * CHUNK_SIZE;
   int bk = chunk_index.y * CHUNK_SIZE;
   
@@ -117,131 +144,153 @@ std::unordered_set<glm::ivec3> TerrainGen::carve_set(glm::ivec2 chunk_index) {
     cave_points[i] = prev + toSpherical(3, theta, phi);
   }
 
-  std::unordered_set<glm::ivec3> carve_voxel_set;
-  auto carve_ball = [](glm::vec3 curr_pos, std::unordered_set<glm::ivec3>& carve_set) {
-    
-    constexpr int sphere_radius = 5;
-    for (int ri = -sphere_radius; ri < sphere_radius; ++ri)
-    for (int rj = -sphere_radius; rj < sphere_radius; ++rj)
-    for (int rk = -sphere_radius; rk < sphere_radius; ++rk)
-    {
-      glm::ivec3 current_voxel = glm::ivec3(curr_pos) + glm::ivec3(ri, rj, rk);
-      if (glm::distance(glm::vec3(current_voxel), curr_pos) < sphere_radius) {
-        carve_set.emplace(current_voxel);
-      }
-    }
-  };
-
-  // carve out cave
+  std::vector<glm::vec3> balls;
   for (int i = 0; i < point_count - 1; ++i) {
 
     // interpolate between point 0 and point 1
     for (float d = 0; d < 1; d += 0.3) {
-      glm::vec3 curr_pos = glm::mix(cave_points[i], cave_points[i + 1], d);
-      carve_ball(curr_pos, carve_voxel_set);
+      balls.push_back(glm::mix(cave_points[i], cave_points[i + 1], d));
     }
   }
-
-  return carve_voxel_set;
+  return balls;
 }
 
-void TerrainGen::caves(World& world, glm::ivec2 chunk_index) {
-  assert(world.chunk(chunk_index)->_state == Chunk::State::Generated_Ground);
-  
-  int bi = chunk_index.x * CHUNK_SIZE;
-  int bk = chunk_index.y * CHUNK_SIZE;
-  
-  /// Cave generation pass
-
-  // don't carve as many caves
-  if (perlin(bi/15.f, bk/15.f) < 0.2) {
-
-    std::unordered_set<glm::ivec3> carve_voxel_set = carve_set(chunk_index);
-
-    for (glm::ivec3 voxel : carve_voxel_set) {
-      // in the world
-      if (voxel.y >= 0 && voxel.y < CHUNK_HEIGHT) {
-
-        // in this chunk
-        if (voxel.x >= bi && voxel.z >= bk
-            && voxel.x < bi + CHUNK_SIZE && voxel.z < bk + CHUNK_SIZE) {
-          auto& block = world(voxel.x, voxel.y, voxel.z);
-          if (block != Terrain::WATER) {
-            block = Terrain::AIR;
-          }
-        } else {
-          cave_voxels_to_be_carved.emplace(voxel);
-        }
-      }
+/// the balls of every cave that reaches chunk_index, or a chunk up to margin chunks around it
+static std::vector<glm::vec3> cavesAround(glm::ivec2 chunk_index, int margin) {
+  std::vector<glm::vec3> balls;
+  for (int x = -CAVE_REACH - margin; x <= CAVE_REACH + margin; ++x)
+  for (int z = -CAVE_REACH - margin; z <= CAVE_REACH + margin; ++z) {
+    glm::ivec2 source = chunk_index + glm::ivec2(x, z);
+    if (hasCave(source)) {
+      std::vector<glm::vec3> cave = caveBalls(source);
+      balls.insert(balls.end(), cave.begin(), cave.end());
     }
   }
+  return balls;
+}
 
-  // neighboring caves
-  for (glm::ivec3 voxel : cave_voxels_to_be_carved) {
-    glm::ivec2 voxel_chunk_index = World::toChunk(voxel);
-    if (world.hasChunk(voxel_chunk_index) && world.chunk(voxel_chunk_index)->_state >= Chunk::State::Generated_Caves) {
-      auto& block = world(voxel.x, voxel.y, voxel.z);
-      if (block != Terrain::WATER) {
-        block = Terrain::AIR;
-      }
+/// call f for every voxel of the ball around centre that is in [lo, hi)
+template <typename F>
+static void carveBall(glm::vec3 centre, glm::ivec3 lo, glm::ivec3 hi, F f) {
+  glm::ivec3 from = glm::max(glm::ivec3(centre) - glm::ivec3(CAVE_RADIUS), lo);
+  glm::ivec3 to = glm::min(glm::ivec3(centre) + glm::ivec3(CAVE_RADIUS), hi);
+  for (int i = from.x; i < to.x; ++i)
+  for (int j = from.y; j < to.y; ++j)
+  for (int k = from.z; k < to.z; ++k)
+  {
+    glm::ivec3 current_voxel {i, j, k};
+    if (glm::distance(glm::vec3(current_voxel), centre) < CAVE_RADIUS) {
+      f(current_voxel);
     }
   }
-
-  world.chunk(chunk_index)->_state = Chunk::State::Generated_Caves;
 }
 
-float rand1() {
-  return rand()/(float)RAND_MAX;
+std::unordered_set<glm::ivec3> TerrainGen::carve_set(glm::ivec2 chunk_index) {
+  std::unordered_set<glm::ivec3> carve_voxel_set;
+  glm::ivec3 everywhere {1 << 30};
+  for (glm::vec3 centre : caveBalls(chunk_index)) {
+    carveBall(centre, -everywhere, everywhere, [&](glm::ivec3 voxel) {
+      carve_voxel_set.emplace(voxel);
+    });
+  }
+  return carve_voxel_set;
 }
 
-glm::vec2 circle_rand() {
-  constexpr float TWO_PI = 6.28318530717958647692528676655900576;
-  float theta = rand1() * TWO_PI;
-  return glm::vec2 {glm::cos(theta), glm::sin(theta)};
+void TerrainGen::caves(World& world, glm::ivec2 chunk_index) {
+  Chunk* chunk = world.chunk(chunk_index);
+  assert(chunk->_state == Chunk::State::Generated_Ground);
+  
+  /// Cave generation pass
+
+  // this chunk's part of its own cave and of every cave from around it
+  glm::ivec3 origin {chunk_index.x * CHUNK_SIZE, 0, chunk_index.y * CHUNK_SIZE};
+  glm::ivec3 end = origin + glm::ivec3(CHUNK_SIZE, CHUNK_HEIGHT, CHUNK_SIZE);
+  for (glm::vec3 centre : cavesAround(chunk_index, 0)) {
+    carveBall(centre, origin, end, [&](glm::ivec3 voxel) {
+      glm::ivec3 local = voxel - origin;
+      if (chunk->get(local.x, local.y, local.z) != Terrain::WATER) {
+        chunk->set(local.x, local.y, local.z, Terrain::AIR);
+      }
+    });
+  }
+
+  chunk->setState(Chunk::State::Generated_Caves);
+  world.account(chunk);
 }
 
-void TerrainGen::trees(World& world, glm::ivec2 chunk_index) {
-  assert(world.chunk(chunk_index)->_state == Chunk::State::Generated_Caves);
-  int bi = chunk_index.x * CHUNK_SIZE;
-  int bk = chunk_index.y * CHUNK_SIZE;
-  
-  /// Tree pass
-  struct Tree_ {
-    glm::ivec2 pos;
-    float size; // 0 .. 3
+struct Tree {
+  glm::ivec2 pos;
+  float size; // 0 .. 3
+};
+
+// a tree's walk ends at most 59 blocks from its chunk's corner and its leaves spread 6 more,
+// so the trees that reach a chunk come from at most 4 chunks away
+constexpr int TREE_REACH = 4;
+constexpr int LEAF_SPREAD = 6;
+
+/// where the chunk's trees go, drawn from a generator seeded with the chunk index
+static std::vector<Tree> treesOf(glm::ivec2 chunk_index) {
+  std::minstd_rand random {uint32_t(chunk_index.x) * 73856093u ^ uint32_t(chunk_index.y) * 19349663u};
+  auto rand1 = [&random]() {
+    return (random() - random.min()) / float(random.max() - random.min());
+  };
+  auto circle_rand = [&rand1]() {
+    float theta = rand1() * glm::two_pi<float>();
+    return glm::vec2 {glm::cos(theta), glm::sin(theta)};
   };
 
-  // decide where to put trees
-  std::vector<Tree_> trees;
-
+  std::vector<Tree> trees;
   auto curr = glm::ivec2 {1 + rand1() * 4, 1 + rand1() * 4};
   for (int try_number = 0; try_number < 10; ++try_number) 
   {
     float tree_size = rand1() * 3;
-    trees.emplace_back(Tree_{
+    trees.emplace_back(Tree{
       chunk_index * glm::ivec2(CHUNK_SIZE) + curr, 
       tree_size
     });
 
     curr += glm::floor(glm::vec2(tree_size + 3) * circle_rand());
   }
+  return trees;
+}
+
+void TerrainGen::trees(World& world, glm::ivec2 chunk_index) {
+  Chunk* chunk = world.chunk(chunk_index);
+  assert(chunk->_state == Chunk::State::Generated_Caves);
+  
+  /// Tree pass
+
+  // this chunk's part of every tree that reaches it, in the same order whichever chunk plants them.
+  // a tree stands on its column as ground and caves left it, trees planted before it do not count
+  glm::ivec3 origin {chunk_index.x * CHUNK_SIZE, 0, chunk_index.y * CHUNK_SIZE};
+  auto set = [&](int i, int j, int k, u_char block) {
+    glm::ivec3 local = glm::ivec3(i, j, k) - origin;
+    if (local.x >= 0 && local.x < CHUNK_SIZE && local.z >= 0 && local.z < CHUNK_SIZE && j < CHUNK_HEIGHT) {
+      chunk->set(local.x, j, local.z, block);
+    }
+  };
+  std::vector<glm::vec3> balls = cavesAround(chunk_index, 1);
 
-  // second pass tree planting
   auto plant_tree = [&](glm::ivec2 pos, float size) {
     // find the block to plant upon
-    float max_height = CHUNK_HEIGHT - 1;
-
-    // if we have not yet generated/instantiated the chunk
-    if (not world.hasChunk(World::toChunk({pos.x, 0, pos.y}))) {
-      return;
+    std::array<u_char, CHUNK_HEIGHT> column;
+    groundColumn(pos.x, pos.y, column);
+    glm::ivec3 lo {pos.x, 0, pos.y};
+    for (glm::vec3 centre : balls) {
+      carveBall(centre, lo, lo + glm::ivec3(1, CHUNK_HEIGHT, 1), [&](glm::ivec3 voxel) {
+        if (column[voxel.y] != Terrain::WATER) {
+          column[voxel.y] = Terrain::AIR;
+        }
+      });
     }
-    
+
+    int max_height = CHUNK_HEIGHT - 1;
     for (; max_height >= 40; --max_height) {
-      if (world(pos.x, max_height, pos.y)) {
+      if (column[max_height]) {
         break;
       }
     }
-    if (world(pos.x, max_height, pos.y) != Terrain::GRASS) {
+    if (column[max_height] != Terrain::GRASS) {
       return;
     }
     
@@ -256,26 +305,30 @@ void TerrainGen::trees(World& world, glm::ivec2 chunk_index) {
       for (int i = -floof_layer_radius; i <= floof_layer_radius; ++i) 
       for (int k = -floof_layer_radius; k <= floof_layer_radius; ++k)
       {
-        int y = max_height + tree_height + j;
-        if (y < CHUNK_HEIGHT) {
-          world.forceGet(pos.x + i, y, pos.y + k) = Terrain::LEAF;
-        }
+        set(pos.x + i, max_height + tree_height + j, pos.y + k, Terrain::LEAF);
       }
     }
 
     for (int dj = 0; dj < tree_height; ++dj) {  
-      int y = max_height + dj;
-      if (y < CHUNK_HEIGHT) {
-        world(pos.x, y, pos.y) = Terrain::DIRT;
-      }
+      set(pos.x, max_height + dj, pos.y, Terrain::DIRT);
     }
   };
 
-  for (auto tree : trees) {
-    plant_tree(tree.pos, tree.size);
+  for (int x = -TREE_REACH; x <= TREE_REACH; ++x)
+  for (int z = -TREE_REACH; z <= TREE_REACH; ++z) {
+    for (Tree tree : treesOf(chunk_index + glm::ivec2(x, z))) {
+      if (tree.pos.x + LEAF_SPREAD >= origin.x && tree.pos.x - LEAF_SPREAD < origin.x + CHUNK_SIZE
+          && tree.pos.y + LEAF_SPREAD >= origin.z && tree.pos.y - LEAF_SPREAD < origin.z + CHUNK_SIZE) {
+        plant_tree(tree.pos, tree.size);
+      }
+    }
   }
 
-  world.chunk(chunk_index)->_state = Chunk::State::Generated_Trees;
+  // every pass is in, so the chunk is lit once as a whole rather than block by block as they wrote
+  Light::initial(*chunk);
+  chunk->setState(Chunk::State::Generated_Trees);
+  Light::join(world, chunk_index);
+  world.account(chunk);
 }
 
 void TerrainGen::chunk(World& world, glm::ivec2 chunk_index) {
@@ -283,7 +336,9 @@ void TerrainGen::chunk(World& world, glm::ivec2 chunk_index) {
   assert (world.chunk(chunk_index)->_state < Chunk::State::Generated);
 
   if (world.chunk(chunk_index)->_state == Chunk::State::Exists) {
-    ground(world.chunk(chunk_index), chunk_index);
+    Column column;
+    ground(column, chunk_index);
+    world.installGround(chunk_index, std::move(column));
   }
 
   if (world.chunk(chunk_index)->_state == Chunk::State::Generated_Ground) {
@@ -10,14 +10,19 @@
 struct Player;
 struct World;
 struct Chunk;
+struct Column;
 
 namespace TerrainGen {
   void spawn(World& world, Player& player);
   void chunk(World& world, glm::ivec2 chunk_index);
   
-  void ground(Chunk*, glm::ivec2 chunk_index);
+  /// terrain of a chunk into a column of its own, touches nothing else so it can run on a worker.
+  ///   World::installGround merges the column in on the main thread
+  void ground(Column& column, glm::ivec2 chunk_index);
 
   std::unordered_set<glm::ivec3> carve_set(glm::ivec2 chunk_index);
+  /// carve the caves that reach this chunk, its own and its neighbours', into this chunk only
   void caves(World& world, glm::ivec2 chunk_index);
+  /// plant the parts of every tree that reaches this chunk, into this chunk only
   void trees(World& world, glm::ivec2 chunk_index);
 }
\ No newline at end of file
@@ -0,0 +1,135 @@
+#include "Visibility.h"
+#include "World.h"
+
+#include <array>
+#include <vector>
+
+namespace {
+  constexpr int N = SECTION_SIZE;
+
+  /// a step from a section through each face
+  constexpr int STEP[6][3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}, {-1, 0, 0}, {0, -1, 0}, {0, 0, -1}};
+
+  /// half the diagonal of a section: anything whose center is further behind the eye than this is behind it
+  constexpr float BEHIND = 0.8661f * SECTION_SIZE;
+}
+
+uint16_t Visibility::graph(const Section& section) {
+  if (section.uniform()) {
+    return Section::isOpaque(section.uniformBlock()) ? 0 : ALL;
+  }
+
+  // every run of open cells along x in rows r = j * N + k, at most N / 2 per row
+  constexpr int MAX_RUNS = N * N * N / 2;
+  std::array<uint16_t, MAX_RUNS> runs;
+  std::array<int16_t, MAX_RUNS> parent;
+  std::array<uint8_t, MAX_RUNS> faces; // faces reached by the component, kept at its root
+  std::array<int16_t, N * N + 1> first; // the runs of row r are [first[r], first[r + 1])
+
+  auto find = [&](int a) {
+    while (parent[a] != a) {
+      a = parent[a] = parent[parent[a]];
+    }
+    return a;
+  };
+  auto join = [&](int a, int b) {
+    a = find(a);
+    b = find(b);
+    if (a != b) {
+      parent[b] = a;
+      faces[a] |= faces[b];
+    }
+  };
+
+  int count = 0;
+  for (int r = 0; r < N * N; ++r) {
+    int j = r / N, k = r % N;
+    first[r] = count;
+    uint16_t open = ~section.opaqueRow(j, k);
+    while (open) {
+      // adding the lowest bit carries through the run it starts, which leaves just the run out
+      uint16_t run = open & ~uint16_t(uint32_t(open) + (open & -open));
+      open &= ~run;
+      runs[count] = run;
+      parent[count] = count;
+      faces[count] = (run >> (N - 1) & 1) << 0 | (j == N - 1) << 1 | (k == N - 1) << 2
+                   | (run & 1) << 3             | (j == 0) << 4     | (k == 0) << 5;
+      // one pass joins each run with the runs it touches in the rows before it, at k - 1 and at j - 1
+      for (int before : {k > 0 ? r - 1 : -1, j > 0 ? r - N : -1}) {
+        for (int b = before < 0 ? 0 : first[before]; before >= 0 && b < first[before + 1]; ++b) {
+          if (runs[b] & run) {
+            join(b, count);
+          }
+        }
+      }
+      ++count;
+    }
+  }
+  first[N * N] = count;
+
+  // the faces a component reaches all see each other
+  uint16_t graph = 0;
+  for (int a = 0; a < count; ++a) {
+    if (parent[a] != a) {
+      continue;
+    }
+    for (int x = 0; x < 6; ++x)
+    for (int y = x + 1; y < 6; ++y) {
+      if ((faces[a] >> x & 1) && (faces[a] >> y & 1)) {
+        graph |= 1 << pair(x, y);
+      }
+    }
+  }
+  return graph;
+}
+
+Visibility::Sections Visibility::visible(const World& world, glm::vec3 eye, glm::vec3 look) {
+  struct Node {
+    glm::ivec2 chunk_index;
+    int s;
+    int from;  // the face it was entered through, -1 for the camera's own section
+    int taken; // directions stepped in to get here: never back against one of them
+  };
+
+  Sections visible;
+  glm::ivec3 block = World::toBlock(eye);
+  glm::ivec2 start = World::toChunk(block);
+  int s = glm::clamp(block.y, 0, CHUNK_HEIGHT - 1) / SECTION_SIZE;
+  if (not world.hasChunk(start)) {
+    return visible;
+  }
+
+  std::vector<Node> queue {{start, s, -1, 0}};
+  visible[start] |= 1u << s;
+  for (size_t q = 0; q < queue.size(); ++q) {
+    Node node = queue[q];
+    const Chunk* chunk = world._chunks.at(node.chunk_index);
+    uint16_t graph = chunk->_state == Chunk::State::Built ? chunk->_visibility[node.s] : ALL;
+
+    for (int d = 0; d < 6; ++d) {
+      if ((node.taken >> opposite(d) & 1) || (node.from >= 0 && not connected(graph, node.from, d))) {
+        continue;
+      }
+      glm::ivec2 next_index = node.chunk_index + glm::ivec2(STEP[d][0], STEP[d][2]);
+      int next_s = node.s + STEP[d][1];
+      glm::ivec2 off = next_index - start;
+      if (next_s < 0 || next_s >= SECTION_COUNT || glm::max(std::abs(off.x), std::abs(off.y)) > RENDER_DISTANCE
+          || not world.hasChunk(next_index)) {
+        continue;
+      }
+      // blocks sit on integer coordinates, so a section's center is half a block short of its middle block
+      glm::vec3 center = glm::vec3(next_index.x * CHUNK_SIZE, next_s * SECTION_SIZE, next_index.y * CHUNK_SIZE)
+                         + glm::vec3(SECTION_SIZE / 2.f - 0.5f);
+      if (glm::dot(center - eye, look) < -BEHIND) {
+        continue;
+      }
+      uint32_t& sections = visible[next_index];
+      if (sections >> next_s & 1) {
+        continue;
+      }
+      sections |= 1u << next_s;
+      queue.push_back({next_index, next_s, opposite(d), node.taken | 1 << d});
+    }
+  }
+  return visible;
+}
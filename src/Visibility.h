@@ -0,0 +1,56 @@
+#pragma once
+
+#include "Config.h"
+#include "Section.h"
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/gtx/hash.hpp>
+
+#include <cstdint>
+#include <unordered_map>
+
+struct World;
+
+/// cave culling. every section of a built chunk has a graph of which of its six faces see each other
+/// through cells that are not opaque, made when it is meshed. each frame a breadth-first search from the
+/// camera's section goes only where those graphs let it and only away from the camera, and just the
+/// sections it reaches are drawn: caves behind solid rock and the far sides of hills are never sent.
+/// of those, only the directions of faces that can turn towards the camera are, see facing.
+///   faces are numbered like mesh directions, 0 .. 5 = x, y, z, -x, -y, -z
+namespace Visibility {
+  constexpr uint16_t ALL = 0x7FFF; // every pair of faces connected: air, water, and anything not loaded yet
+
+  /// the bit of faces a and b in a graph, a != b
+  constexpr int pair(int a, int b) {
+    return a < b ? a * (11 - a) / 2 + b - a - 1 : pair(b, a);
+  }
+
+  inline bool connected(uint16_t graph, int a, int b) {
+    return graph >> pair(a, b) & 1;
+  }
+
+  constexpr int opposite(int face) { return (face + 3) % 6; }
+
+  constexpr uint8_t ALL_DIRECTIONS = 0x3F;
+
+  /// the directions of the faces of blocks from lo to hi, both included, that can face eye. a face in
+  /// direction +x lies half a block past its block's x and is seen only from beyond that, and so on
+  inline uint8_t facing(glm::ivec3 lo, glm::ivec3 hi, glm::vec3 eye) {
+    uint8_t directions = 0;
+    for (int a = 0; a < 3; ++a) {
+      directions |= (eye[a] > lo[a] + 0.5f) << a;
+      directions |= (eye[a] < hi[a] - 0.5f) << (a + 3);
+    }
+    return directions;
+  }
+
+  /// which faces of a section connect through cells that are not opaque, flood filled a row at a time
+  uint16_t graph(const Section& section);
+
+  /// sections to draw: bit s for section s of a chunk, chunks with none left out
+  using Sections = std::unordered_map<glm::ivec2, uint32_t>;
+
+  /// the sections of chunks in the active set reachable from eye, searching along look
+  Sections visible(const World& world, glm::vec3 eye, glm::vec3 look);
+}
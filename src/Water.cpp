@@ -0,0 +1,191 @@
+#include "Water.h"
+#include "World.h"
+
+#include <algorithm>
+#include <tuple>
+
+namespace {
+  /// the cells whose next block depends on the block at p: p, its neighbours, and the cells above
+  /// its sides, which spread only if what they flow from rests on p
+  constexpr int AFFECTED[11][3] = {
+    {0, 0, 0},
+    {1, 0, 0}, {-1, 0, 0}, {0, 0, 1}, {0, 0, -1}, {0, 1, 0}, {0, -1, 0},
+    {1, 1, 0}, {-1, 1, 0}, {0, 1, 1}, {0, 1, -1},
+  };
+
+  constexpr int SIDES[4][3] = {{1, 0, 0}, {0, 0, 1}, {-1, 0, 0}, {0, 0, -1}};
+
+  /// the block at p. chunks that are not loaded or not generated yet, and the bottom of the world,
+  /// are walls: water stops at them until they are
+  u_char at(const World& world, glm::ivec3 p) {
+    if (p.y < 0) {
+      return Terrain::STONE;
+    }
+    if (p.y >= CHUNK_HEIGHT) {
+      return Terrain::AIR;
+    }
+    glm::ivec2 chunk_index = World::toChunk(p);
+    auto it = world._chunks.find(chunk_index);
+    if (it == world._chunks.end() || it->second->_state < Chunk::State::Generated) {
+      return Terrain::STONE;
+    }
+    glm::ivec3 local = World::toLocal(p);
+    return it->second->get(local.x, local.y, local.z);
+  }
+
+  /// whether the next block at p can differ from a block that is not liquid: p or a cell it reads is liquid
+  bool readsLiquid(const World& world, glm::ivec3 p) {
+    for (auto [x, y, z] : AFFECTED) {
+      if (Terrain::has(at(world, p - glm::ivec3(x, y, z)), Terrain::LIQUID)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /// water at p may spread sideways: it lies on something that holds it up
+  bool rests(const World& world, glm::ivec3 p) {
+    u_char below = at(world, p - glm::ivec3(0, 1, 0));
+    return Terrain::has(below, Terrain::OPAQUE) || Terrain::LEVEL[below] == Terrain::SOURCE_LEVEL;
+  }
+
+  /// which section a cell is in, for grouping a tick's cells
+  std::tuple<int, int, int> sectionOf(glm::ivec3 p) {
+    glm::ivec2 chunk_index = World::toChunk(p);
+    return {chunk_index.x, chunk_index.y, p.y / SECTION_SIZE};
+  }
+}
+
+u_char Water::next(const World& world, glm::ivec3 p) {
+  u_char block = at(world, p);
+  int level = Terrain::LEVEL[block];
+  if (block != Terrain::AIR && (level == 0 || level == Terrain::SOURCE_LEVEL)) {
+    return block;
+  }
+
+  if (Terrain::LEVEL[at(world, p + glm::ivec3(0, 1, 0))]) {
+    return Terrain::flowing(Terrain::SOURCE_LEVEL - 1);
+  }
+  int fed = 0;
+  for (auto [x, y, z] : SIDES) {
+    glm::ivec3 side = p + glm::ivec3(x, y, z);
+    int side_level = Terrain::LEVEL[at(world, side)];
+    if (side_level > fed + 1 && rests(world, side)) {
+      fed = side_level - 1;
+    }
+  }
+  return fed ? Terrain::flowing(fed) : Terrain::AIR;
+}
+
+void Water::queue(glm::ivec3 p) {
+  if (_queued.insert(p).second) {
+    _active.push_back(p);
+  }
+}
+
+void Water::wake(const World& world, glm::ivec3 p) {
+  bool near_liquid = false;
+  for (auto [x, y, z] : AFFECTED) {
+    if (Terrain::has(at(world, p + glm::ivec3(x, y, z)), Terrain::LIQUID)) {
+      near_liquid = true;
+      break;
+    }
+  }
+  if (near_liquid) {
+    for (auto [x, y, z] : AFFECTED) {
+      queue(p + glm::ivec3(x, y, z));
+    }
+  }
+}
+
+void Water::wake(const World& world, Box box) {
+  // most bulk edits happen nowhere near water, the summaries say so without reading a voxel
+  Box around {box.min - glm::ivec3(1), box.max + glm::ivec3(1, 2, 1)};
+  bool near_liquid = false;
+  for (int b = 0; b < Terrain::BLOCK_COUNT && not near_liquid; ++b) {
+    near_liquid = Terrain::has(b, Terrain::LIQUID) && world.anyOfType(around, b);
+  }
+  if (not near_liquid) {
+    return;
+  }
+
+  // a cell more than a block inside box reads nothing but box. if that is all one block and does not
+  // flow, as after a fill, none of it can change: only the border and the shell around it are queued
+  Box inner {box.min + glm::ivec3(1), box.max - glm::ivec3(1)};
+  bool still = true;
+  if (not inner.empty()) {
+    glm::ivec3 size = inner.size();
+    u_char block = at(world, inner.min);
+    int level = Terrain::LEVEL[block];
+    still = (level == 0 || level == Terrain::SOURCE_LEVEL)
+            && world.countInBox(inner, block) == size_t(size.x) * size.y * size.z;
+  }
+  Box shell {box.min - glm::ivec3(1), box.max + glm::ivec3(1)};
+  for (int i = shell.min.x; i < shell.max.x; ++i)
+  for (int j = shell.min.y; j < shell.max.y; ++j)
+  for (int k = shell.min.z; k < shell.max.z; ++k) {
+    glm::ivec3 q {i, j, k};
+    if (still && inner.contains(q)) {
+      k = inner.max.z - 1;
+      continue;
+    }
+    if (readsLiquid(world, q)) {
+      queue(q);
+    }
+  }
+}
+
+bool Water::update(World& world, double dt) {
+  _time += dt;
+  if (_time < WATER_TICK) {
+    return false;
+  }
+  _time = std::min(_time - WATER_TICK, WATER_TICK);
+  if (settled()) {
+    return false;
+  }
+  tick(world);
+  return true;
+}
+
+void Water::tick(World& world) {
+  ++_ticks;
+  size_t count = std::min<size_t>(_active.size(), WATER_TICK_BUDGET);
+  std::vector<glm::ivec3> cells(_active.begin(), _active.begin() + count);
+  _active.erase(_active.begin(), _active.begin() + count);
+  for (glm::ivec3 p : cells) {
+    _queued.erase(p);
+  }
+
+  // one group of cells per section. the groups only read the world, so they run on any thread
+  std::sort(cells.begin(), cells.end(), [](glm::ivec3 a, glm::ivec3 b) {
+    return std::make_tuple(sectionOf(a), a.x, a.y, a.z) < std::make_tuple(sectionOf(b), b.x, b.y, b.z);
+  });
+  std::vector<size_t> groups {0};
+  for (size_t c = 1; c < cells.size(); ++c) {
+    if (sectionOf(cells[c]) != sectionOf(cells[c - 1])) {
+      groups.push_back(c);
+    }
+  }
+  groups.push_back(cells.size());
+
+  std::vector<u_char> before(cells.size()), after(cells.size());
+  #pragma omp parallel for schedule(dynamic)
+  for (int g = 0; g < int(groups.size()) - 1; ++g) {
+    for (size_t c = groups[g]; c < groups[g + 1]; ++c) {
+      before[c] = at(world, cells[c]);
+      after[c] = next(world, cells[c]);
+    }
+  }
+
+  // then every change goes in at once, which wakes the cells around it for the next tick
+  std::vector<std::pair<glm::ivec3, u_char>> writes;
+  for (size_t c = 0; c < cells.size(); ++c) {
+    if (after[c] != before[c]) {
+      writes.emplace_back(cells[c], after[c]);
+    }
+  }
+  _last_cells = cells.size();
+  _last_changes = writes.size();
+  world.setBlocks(writes);
+}
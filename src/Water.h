@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Config.h"
+#include "Box.h"
+
+#include <glm/vec3.hpp>
+#include <glm/gtx/hash.hpp>
+
+#include <sys/types.h>
+#include <cstddef>
+#include <deque>
+#include <unordered_set>
+#include <vector>
+
+struct World;
+
+/// flowing water, a cellular automaton over the cells that might change.
+///
+/// sources (Terrain::WATER) never change on their own. every other cell that is air or flowing water
+/// settles on a level from the cells around it each tick: full (SOURCE_LEVEL - 1) under any water, else
+/// one less than the fullest neighbour on the side that rests on something, so water falls first and
+/// spreads sideways only where it lands, and dries up when nothing feeds it anymore.
+///
+/// only active cells are looked at: a block write next to a liquid wakes the cell and its neighbours,
+/// and so does every change a tick makes. a tick reads the world as it was when the tick started,
+/// section by section in parallel, then writes its changes in one batch on the main thread
+struct Water {
+  std::deque<glm::ivec3> _active;          // cells to look at, oldest first
+  std::unordered_set<glm::ivec3> _queued;  // the same cells, so no cell is queued twice
+  double _time = 0;                        // seconds not simulated yet
+  size_t _ticks = 0;
+  size_t _last_cells = 0;                  // cells the last tick looked at
+  size_t _last_changes = 0;                // blocks the last tick wrote
+
+  /// a block at p was written: look at it and its neighbours next tick if any of them is a liquid
+  void wake(const World& world, glm::ivec3 p);
+  /// blocks anywhere in box may have changed. a box left all one block that does not flow, such as a
+  /// fill, wakes only its border and the shell around it
+  void wake(const World& world, Box box);
+
+  /// time passed: run a tick if one is due. at most one per call, so a slow frame drops time
+  /// instead of catching up with several budgets in a row
+  bool update(World& world, double dt);
+
+  /// look at up to WATER_TICK_BUDGET active cells and write the ones that change
+  void tick(World& world);
+
+  bool settled() const { return _active.empty(); }
+
+  /// the block p should be, given the blocks around it now. p itself if nothing flows there
+  static u_char next(const World& world, glm::ivec3 p);
+
+private:
+  void queue(glm::ivec3 p);
+};
@@ -1,6 +1,10 @@
 #include "World.h"
 #include "Player.h"
+#include "ChunkStore.h"
+#include "TerrainGen.h"
+#include "Lod.h"
 #include <iostream>
+#include <cmath>
 #include <glm/gtx/string_cast.hpp>
 
 World::World(Player& player) : _player_chunk_index(toChunk(player.blockPosition())) {
@@ -19,11 +23,15 @@ void World::handleTick(Player& player) {
 void World::updateActiveSet(Player& player) {
   auto chunk_index = toChunk(player.blockPosition());
 
+  ++_tick;
   _active_set.clear();
   for (int i = -RENDER_DISTANCE; i <= RENDER_DISTANCE; ++i)
   for (int k = -RENDER_DISTANCE; k <= RENDER_DISTANCE; ++k) {
     glm::ivec2 curr_index = chunk_index + glm::ivec2(i, k);
     _active_set.emplace_back(curr_index);
+    if (hasChunk(curr_index)) {
+      _chunks.at(curr_index)->_last_used = _tick;
+    }
   }
   glm::vec2 pos {player.head().x, player.head().z};
   std::sort(_active_set.begin(), _active_set.end(), [pos](glm::ivec2 a, glm::ivec2 b) {
@@ -32,67 +40,314 @@ void World::updateActiveSet(Player& player) {
   });
 }
 
-// requires that every element of _active_set be present in _chunks and be generated
-void World::build(std::vector<Instance>& instances) {
+Chunk* World::create(glm::ivec2 chunk_index) {
+  assert (not hasChunk(chunk_index));
+  Chunk* chunk = chunkPool().create();
+  chunk->_last_used = _tick;
+  // light is not saved, a chunk read back from disk is lit again
+  std::vector<Scheduler::Suspended> updates;
+  if (ChunkStore::load(*chunk, chunk_index, updates)) {
+    Light::initial(*chunk);
+  }
+  _chunks.emplace(chunk_index, chunk);
+  account(chunk);
+  link(chunk_index, chunk);
+  _updates.resume(chunk_index, updates);
+  if (chunk->_state >= Chunk::State::Generated) {
+    Light::join(*this, chunk_index);
+  }
+  return chunk;
+}
 
-  instances.clear();
+void World::installGround(glm::ivec2 chunk_index, Column&& column) {
+  Chunk* chunk = _chunks.at(chunk_index);
+  chunk->installGround(std::move(column));
+  account(chunk);
+}
 
-  std::vector<glm::ivec2> already_built_set;
-  std::copy_if(_active_set.begin(), _active_set.end(), std::back_inserter(already_built_set), 
-    [this](glm::ivec2 chunk_index) 
-    { 
-      if (not hasChunk(chunk_index)) {
-        return false;
+void World::setBlocks(const std::vector<std::pair<glm::ivec3, u_char>>& writes) {
+  std::vector<glm::ivec3> lit;
+  size_t first_change = _journal.blocks.size();
+  for (auto [p, block] : writes) {
+    glm::ivec2 chunk_index = toChunk(p);
+    assert (hasChunk(chunk_index));
+    assert (p.y >= 0 && p.y < CHUNK_HEIGHT);
+    Chunk* chunk = _chunks.at(chunk_index);
+    glm::ivec3 local = toLocal(p);
+    int di = local.x;
+    int dk = local.z;
+    u_char old_block = chunk->get(di, p.y, dk);
+    if (old_block == block) {
+      continue;
+    }
+    chunk->set(di, p.y, dk, block);
+    account(chunk);
+    if (chunk->_state >= Chunk::State::Generated) {
+      lit.push_back(p);
+      chunk->_modified = true;
+      if (not _subscribers.empty()) {
+        _journal.blocks.push_back({p, old_block, block, 0});
       }
+      _updates.blockChanged(*this, p, old_block);
+    }
+  }
+  if (not lit.empty()) {
+    Light::update(*this, lit);
+  }
+  // versions once the whole batch is relit, and water only looks at the batch once it is all in
+  for (size_t c = first_change; c < _journal.blocks.size(); ++c) {
+    _journal.blocks[c].version = _chunks.at(toChunk(_journal.blocks[c].position))->_version;
+  }
+  for (auto [p, block] : writes) {
+    if (_chunks.at(toChunk(p))->_state >= Chunk::State::Generated) {
+      _water.wake(*this, p);
+    }
+  }
+}
 
-      const Chunk* chunk = _chunks.at(chunk_index);
+void World::link(glm::ivec2 chunk_index, Chunk* chunk) {
+  chunk->_region = &_regions[toRegion(chunk_index)];
+  chunk->_region->stale = true;
+  for (int n = 0; n < 8; ++n) {
+    auto it = _chunks.find(chunk_index + Chunk::NEIGHBOURS[n]);
+    if (it == _chunks.end()) {
+      continue;
+    }
+    Chunk* neighbour = it->second;
+    chunk->_neighbours[n] = neighbour;
+    neighbour->_neighbours[n ^ 2] = chunk; // n ^ 2 is the opposite direction
+    chunk->_generated_neighbours += neighbour->_state >= Chunk::State::Generated;
+    neighbour->_generated_neighbours += chunk->_state >= Chunk::State::Generated;
+  }
+}
 
-      if (chunk->_state < Chunk::State::Built) {
-        return false;
-      }
+void World::unlink(Chunk* chunk) {
+  for (int n = 0; n < 8; ++n) {
+    if (Chunk* neighbour = chunk->_neighbours[n]) {
+      neighbour->_neighbours[n ^ 2] = nullptr;
+      neighbour->_generated_neighbours -= chunk->_state >= Chunk::State::Generated;
+    }
+  }
+  chunk->_neighbours = {};
+  chunk->_generated_neighbours = 0;
+  chunk->_region->stale = true;
+  chunk->_region = nullptr;
+}
 
-      return true;
-    } );
+void World::evict() {
+  if (_resident <= _memory_budget) {
+    return;
+  }
 
-  // build the chunks that already have instances
-  for (const auto& chunk_index : already_built_set) {
-    _chunks.at(chunk_index)->load(instances);
+  std::vector<glm::ivec2> candidates;
+  for (const auto& [chunk_index, chunk] : _chunks) {
+    glm::ivec2 d = glm::abs(chunk_index - _player_chunk_index);
+    if (glm::max(d.x, d.y) > _retention_distance) {
+      candidates.emplace_back(chunk_index);
+    }
   }
+  std::sort(candidates.begin(), candidates.end(), [this](glm::ivec2 a, glm::ivec2 b) {
+    return _chunks.at(a)->_last_used < _chunks.at(b)->_last_used;
+  });
 
-  // if (not incomplete) {
-    // NOTE: we could have another variable that tells us whether we need to have further building to signal to the main thread
-    //   to not build and waste the time clearing/copying, but there might be a more efficient way of doing this
-    //   -> potentially cache { previous active sets, chunks represented in instance vector }
-    // _might_need_building = false;
-    // _might_need_generation = false;
-  // }
+  for (glm::ivec2 chunk_index : candidates) {
+    if (_resident <= _memory_budget) {
+      break;
+    }
+    Chunk* chunk = _chunks.at(chunk_index);
+    // pending block updates go to disk with the chunk and wait there. a chunk that could not be
+    // saved stays, and so do its updates, rather than losing its edits
+    std::vector<Scheduler::Suspended> updates = _updates.suspend(chunk_index);
+    if ((chunk->_modified || not updates.empty()) && not ChunkStore::save(*chunk, chunk_index, updates)) {
+      _updates.resume(chunk_index, updates);
+      continue;
+    }
+    if (chunk->_state >= Chunk::State::Generated) {
+      _far_field.update(chunk_index, *chunk);
+    }
+    _resident -= chunk->_counted;
+    unlink(chunk);
+    _chunks.erase(chunk_index);
+    chunkPool().destroy(chunk);
+    ++_evictions;
+  }
 }
 
-void World::build_water(std::vector<Instance>& instances) {
+void World::publish() {
+  if (_journal.empty()) {
+    return;
+  }
+  for (const Subscriber& subscriber : _subscribers) {
+    subscriber(_journal);
+  }
+  _journal.clear();
+}
 
-  instances.clear();
+void World::invalidate(Box box) {
+  // one block further up and down reaches every face the box touches in its own chunks. the neighbours
+  // see it through the edges they were meshed against, which remesh compares
+  Box around {box.min - glm::ivec3(0, 1, 0), box.max + glm::ivec3(0, 1, 0)};
+  glm::ivec2 first = toChunk(box.min);
+  glm::ivec2 last = toChunk(box.max - glm::ivec3(1));
+  for (int x = first.x; x <= last.x; ++x)
+  for (int z = first.y; z <= last.y; ++z) {
+    auto it = _chunks.find({x, z});
+    if (it == _chunks.end() || it->second->_state != Chunk::State::Built) {
+      continue;
+    }
+    Box part = around.intersect(chunkBox({x, z}));
+    if (part.empty()) {
+      continue;
+    }
+    int low = part.min.y / SECTION_SIZE, high = (part.max.y - 1) / SECTION_SIZE;
+    it->second->_dirty |= uint32_t((uint64_t(2) << high) - (uint64_t(1) << low));
+  }
+}
 
-  std::vector<glm::ivec2> already_built_set;
-  std::copy_if(_active_set.begin(), _active_set.end(), std::back_inserter(already_built_set), 
-    [this](glm::ivec2 chunk_index) 
-    { 
-      if (not hasChunk(chunk_index)) {
-        return false;
+void World::remesh() {
+  for (glm::ivec2 chunk_index : _active_set) {
+    auto it = _chunks.find(chunk_index);
+    if (it == _chunks.end() || it->second->_state != Chunk::State::Built) {
+      continue;
+    }
+    Chunk* chunk = it->second;
+    // a neighbour's edge that changed since the mesh: only the sections whose rows differ show it.
+    // a neighbour that went away keeps the edge the mesh has
+    for (int n = 0; n < 4; ++n) {
+      const Chunk* neighbour = chunk->_neighbours[n];
+      if (neighbour == nullptr) {
+        continue;
+      }
+      const std::shared_ptr<const Edge>& now = neighbour->edge(n ^ 2);
+      std::shared_ptr<const Edge>& then = chunk->_meshed_against[n];
+      if (now != then) {
+        chunk->_dirty |= then ? now->differ(*then) : Column::ALL_SECTIONS;
+        then = now;
       }
+    }
+    if (chunk->_dirty) {
+      buildChunk(chunk_index, chunk->_dirty);
+    }
+  }
+
+  // levels of detail. all levels first: the skirts a chunk needs depend on the levels around it
+  for (glm::ivec2 chunk_index : _active_set) {
+    auto it = _chunks.find(chunk_index);
+    if (it != _chunks.end() && it->second->_state == Chunk::State::Built) {
+      glm::ivec2 d = glm::abs(chunk_index - _player_chunk_index);
+      it->second->_lod = Lod::level(it->second->_lod, glm::max(d.x, d.y));
+    }
+  }
+  // then the meshes of levels that are missing or out of date, nearest first. until they are made
+  // the chunk draws what it has
+  int budget = LOD_MESHES_PER_FRAME;
+  for (glm::ivec2 chunk_index : _active_set) {
+    auto it = _chunks.find(chunk_index);
+    if (budget == 0) {
+      break;
+    }
+    if (it == _chunks.end() || it->second->_state != Chunk::State::Built) {
+      continue;
+    }
+    Chunk* chunk = it->second;
+    int level = chunk->_lod;
+    // full detail has its own meshes already, and needs skirts only next to another level
+    bool needed = level > 0;
+    for (int n = 0; n < 4; ++n) {
+      needed |= chunk->_neighbours[n] && chunk->_neighbours[n]->_lod != level;
+    }
+    if (needed && chunk->_lods[level].versions != versions(chunk_index)) {
+      buildLod(chunk_index, level);
+      --budget;
+    }
+  }
+}
+
+void World::fill(Box box, u_char block) {
+  edit(box, [block](Chunk& chunk, const Box& part, glm::ivec3) {
+    return chunk.fill(part, block);
+  });
+}
 
-      const Chunk* chunk = _chunks.at(chunk_index);
+void World::replace(Box box, u_char from, u_char to) {
+  edit(box, [from, to](Chunk& chunk, const Box& part, glm::ivec3) {
+    return chunk.replace(part, from, to);
+  });
+}
 
-      if (chunk->_state < Chunk::State::Built) {
-        return false;
+void World::sphere(glm::ivec3 center, int radius, u_char block) {
+  Box bounds {center - glm::ivec3(radius), center + glm::ivec3(radius + 1)};
+  edit(bounds, [&](Chunk& chunk, const Box& part, glm::ivec3 origin) {
+    // one x run per row of the sphere
+    glm::ivec3 c = center - origin;
+    bool changed = false;
+    for (int j = part.min.y; j < part.max.y; ++j)
+    for (int k = part.min.z; k < part.max.z; ++k) {
+      int rest = radius * radius - (j - c.y) * (j - c.y) - (k - c.z) * (k - c.z);
+      if (rest < 0) {
+        continue;
       }
+      int dx = static_cast<int>(std::sqrt(static_cast<float>(rest)));
+      changed |= chunk.fillRun(glm::max(part.min.x, c.x - dx), glm::min(part.max.x, c.x + dx + 1), j, k, block);
+    }
+    chunk.compact();
+    return changed;
+  });
+}
 
-      return true;
-    } );
+Clipboard World::copy(Box box) const {
+  Clipboard clipboard;
+  clipboard.size = glm::max(box.size(), glm::ivec3(0));
+  clipboard.blocks.assign(clipboard.size.x * clipboard.size.y * clipboard.size.z, Terrain::AIR);
 
-  // build the chunks that already have instances
-  for (const auto& chunk_index : already_built_set) {
-    _chunks.at(chunk_index)->load_water(instances);
+  // copying does not edit, so it walks the chunks itself
+  glm::ivec3 at = box.min;
+  box = box.intersect({glm::ivec3(box.min.x, 0, box.min.z), glm::ivec3(box.max.x, CHUNK_HEIGHT, box.max.z)});
+  if (box.empty()) {
+    return clipboard;
   }
+  glm::ivec2 first = toChunk(box.min);
+  glm::ivec2 last = toChunk(box.max - glm::ivec3(1));
+  for (int x = first.x; x <= last.x; ++x)
+  for (int z = first.y; z <= last.y; ++z) {
+    auto it = _chunks.find({x, z});
+    if (it == _chunks.end()) {
+      continue;
+    }
+    Box chunk_box = chunkBox({x, z});
+    Box part = box.intersect(chunk_box).offset(-chunk_box.min);
+    glm::ivec3 d = chunk_box.min - at;
+    for (int i = part.min.x; i < part.max.x; ++i)
+    for (int j = part.min.y; j < part.max.y; ++j)
+    for (int k = part.min.z; k < part.max.z; ++k) {
+      clipboard.at(i + d.x, j + d.y, k + d.z) = it->second->get(i, j, k);
+    }
+  }
+  return clipboard;
+}
+
+void World::paste(const Clipboard& clipboard, glm::ivec3 at) {
+  edit({at, at + clipboard.size}, [&](Chunk& chunk, const Box& part, glm::ivec3 origin) {
+    glm::ivec3 d = origin - at;
+    bool changed = false;
+    for (int i = part.min.x; i < part.max.x; ++i)
+    for (int j = part.min.y; j < part.max.y; ++j)
+    for (int k = part.min.z; k < part.max.z; ++k) {
+      u_char block = clipboard.at(i + d.x, j + d.y, k + d.z);
+      if (chunk.get(i, j, k) != block) {
+        chunk.Column::set(i, j, k, block);
+        changed = true;
+      }
+    }
+    chunk.compact();
+    return changed;
+  });
+}
+
+// requires that every element of _active_set be present in _chunks and be generated
+void World::build(std::vector<Instance>& instances, std::vector<Draw>& draws, const Visibility::Sections* visible,
+                  const glm::vec3* eye) {
+  collect(false, instances, draws, visible, eye);
 
   // if (not incomplete) {
     // NOTE: we could have another variable that tells us whether we need to have further building to signal to the main thread
@@ -103,10 +358,257 @@ void World::build_water(std::vector<Instance>& instances) {
   // }
 }
 
-void World::buildChunk(glm::ivec2 chunk_index) {
+void World::build_water(std::vector<Instance>& instances, std::vector<Draw>& draws, const Visibility::Sections* visible,
+                        const glm::vec3* eye) {
+  collect(true, instances, draws, visible, eye);
+}
+
+void World::collect(bool water, std::vector<Instance>& instances, std::vector<Draw>& draws,
+                    const Visibility::Sections* visible, const glm::vec3* eye) const {
+  instances.clear();
+  draws.clear();
+
+  // the chunks that already have instances, one draw each
+  for (glm::ivec2 chunk_index : _active_set) {
+    auto found = _chunks.find(chunk_index);
+    if (found == _chunks.end() || found->second->_state < Chunk::State::Built) {
+      continue;
+    }
+    const Chunk* chunk = found->second;
+
+    uint32_t sections = Column::ALL_SECTIONS;
+    if (visible) {
+      auto it = visible->find(chunk_index);
+      sections = it == visible->end() ? 0 : it->second;
+    }
+    Chunk::Directions directions = Chunk::allDirections();
+    if (eye) {
+      for (int s = 0; s < SECTION_COUNT; ++s) {
+        glm::ivec3 lo {chunk_index.x * CHUNK_SIZE, s * SECTION_SIZE, chunk_index.y * CHUNK_SIZE};
+        directions[s] = Visibility::facing(lo, lo + glm::ivec3(SECTION_SIZE - 1), *eye);
+      }
+    }
+    size_t first = instances.size();
+    if (water) {
+      chunk->load_water(instances, sections, directions);
+    } else {
+      chunk->load(instances, sections, directions);
+      // where a neighbour is drawn at another level, the skirt on that side closes the seam
+      int level = chunk->drawnLevel();
+      for (int n = 0; n < 4; ++n) {
+        const Chunk* neighbour = chunk->_neighbours[n];
+        if (neighbour && neighbour->_state == Chunk::State::Built && neighbour->drawnLevel() != level) {
+          Chunk::copySections(chunk->_lods[level].skirts[n], instances, sections, directions);
+        }
+      }
+    }
+    if (instances.size() > first) {
+      draws.push_back({chunk_index * CHUNK_SIZE, first, instances.size() - first});
+    }
+  }
+}
+
+void World::buildChunk(glm::ivec2 chunk_index, uint32_t sections) {
+  MeshJob job = snapshot(chunk_index);
+  job.sections = sections;
+  MeshResult result = job.run();
+  [[maybe_unused]] bool installed = install(result);
+  assert (installed);
+}
+
+void World::buildLod(glm::ivec2 chunk_index, int level) {
+  Chunk* chunk = _chunks.at(chunk_index);
+  Lod::mesh(snapshot(chunk_index), level, chunk->_lods[level]);
+  account(chunk);
+}
+
+std::array<uint64_t, 5> World::versions(glm::ivec2 chunk_index) const {
+  const Chunk* chunk = _chunks.at(chunk_index);
+  std::array<uint64_t, 5> result {};
+  result[0] = chunk->_version;
+  for (int n = 0; n < 4; ++n) {
+    result[n + 1] = chunk->_neighbours[n] ? chunk->_neighbours[n]->edgeVersion(n ^ 2) : 0;
+  }
+  return result;
+}
+
+MeshJob World::snapshot(glm::ivec2 chunk_index) const {
   assert (hasChunk(chunk_index));
   assert (_chunks.at(chunk_index)->_state >= Chunk::State::Generated);
-  _chunks.at(chunk_index)->build({chunk_index.x*CHUNK_SIZE, chunk_index.y*CHUNK_SIZE}, 
-      [&](int i, int j, int k){return isAir(i, j, k);}, 
-      [&](int i, int j, int k){return isWater(i, j, k);});
-}
\ No newline at end of file
+
+  const Chunk* chunk = _chunks.at(chunk_index);
+  MeshJob job {chunk_index, versions(chunk_index)};
+  job.column = *chunk;
+  for (int n = 0; n < 4; ++n) {
+    if (chunk->_neighbours[n]) {
+      job.neighbours[n] = chunk->_neighbours[n]->edge(n ^ 2);
+    }
+  }
+  return job;
+}
+
+bool World::install(MeshResult& result) {
+  if (not hasChunk(result.chunk_index) || versions(result.chunk_index) != result.versions) {
+    return false;
+  }
+  Chunk* chunk = _chunks.at(result.chunk_index);
+  chunk->install(result);
+  account(chunk);
+  _far_field.update(result.chunk_index, *chunk);
+  return true;
+}
+
+const RegionSummary& World::summary(glm::ivec2 region_index) const {
+  static const RegionSummary NOTHING_LOADED {0, CHUNK_HEIGHT, -1, false};
+  auto it = _regions.find(region_index);
+  if (it == _regions.end()) {
+    return NOTHING_LOADED;
+  }
+  RegionSummary& summary = it->second;
+  if (not summary.stale) {
+    return summary;
+  }
+  summary = RegionSummary {};
+  summary.stale = false;
+  glm::ivec2 first = region_index * SUMMARY_REGION_CHUNKS;
+  for (int x = 0; x < SUMMARY_REGION_CHUNKS; ++x)
+  for (int z = 0; z < SUMMARY_REGION_CHUNKS; ++z) {
+    auto chunk = _chunks.find(first + glm::ivec2(x, z));
+    if (chunk == _chunks.end()) {
+      continue;
+    }
+    summary.present |= chunk->second->present();
+    glm::ivec2 heights = chunk->second->heights();
+    summary.low = glm::min(summary.low, heights.x);
+    summary.high = glm::max(summary.high, heights.y);
+  }
+  return summary;
+}
+
+/// call f(section, part, origin) for every loaded section in box that may hold block, with part in
+/// section coordinates and origin the section's first block in the world. f returns true to stop early
+template <typename F>
+static void forSections(const World& world, Box box, u_char block, F f) {
+  box = box.intersect({glm::ivec3(box.min.x, 0, box.min.z), glm::ivec3(box.max.x, CHUNK_HEIGHT, box.max.z)});
+  if (box.empty()) {
+    return;
+  }
+  uint32_t bit = 1u << block;
+  glm::ivec2 first = World::toChunk(box.min);
+  glm::ivec2 last = World::toChunk(box.max - glm::ivec3(1));
+  glm::ivec2 first_region = World::toRegion(first);
+  glm::ivec2 last_region = World::toRegion(last);
+
+  for (int rx = first_region.x; rx <= last_region.x; ++rx)
+  for (int rz = first_region.y; rz <= last_region.y; ++rz) {
+    const RegionSummary& region = world.summary({rx, rz});
+    if (not (region.present & bit)) {
+      continue;
+    }
+    // heights bound everything but air
+    if (block != Terrain::AIR && (box.max.y <= region.low || box.min.y > region.high)) {
+      continue;
+    }
+
+    glm::ivec2 from = glm::max(first, glm::ivec2(rx, rz) * SUMMARY_REGION_CHUNKS);
+    glm::ivec2 to = glm::min(last, glm::ivec2(rx, rz) * SUMMARY_REGION_CHUNKS + SUMMARY_REGION_CHUNKS - 1);
+    for (int x = from.x; x <= to.x; ++x)
+    for (int z = from.y; z <= to.y; ++z) {
+      auto it = world._chunks.find({x, z});
+      if (it == world._chunks.end() || not (it->second->present() & bit)) {
+        continue;
+      }
+      Box chunk_box = World::chunkBox({x, z});
+      Box local = box.intersect(chunk_box).offset(-chunk_box.min);
+      for (int s = local.min.y / SECTION_SIZE; s * SECTION_SIZE < local.max.y; ++s) {
+        const Section& section = it->second->_sections[s];
+        if (section.count(block) == 0) {
+          continue;
+        }
+        glm::ivec3 origin = chunk_box.min + glm::ivec3(0, s * SECTION_SIZE, 0);
+        if (f(section, Column::sectionPart(local, s), origin)) {
+          return;
+        }
+      }
+    }
+  }
+}
+
+bool World::anyOfType(Box box, u_char block) const {
+  bool found = false;
+  forSections(*this, box, block, [&](const Section& section, const Box& part, glm::ivec3) {
+    if (Column::coversSection(part)) {
+      found = true;
+      return true;
+    }
+    for (int i = part.min.x; i < part.max.x && not found; ++i)
+    for (int j = part.min.y; j < part.max.y && not found; ++j)
+    for (int k = part.min.z; k < part.max.z && not found; ++k) {
+      found = section.get(i, j, k) == block;
+    }
+    return found;
+  });
+  return found;
+}
+
+size_t World::countInBox(Box box, u_char block) const {
+  size_t count = 0;
+  forSections(*this, box, block, [&](const Section& section, const Box& part, glm::ivec3) {
+    if (Column::coversSection(part)) {
+      count += section.count(block);
+      return false;
+    }
+    for (int i = part.min.x; i < part.max.x; ++i)
+    for (int j = part.min.y; j < part.max.y; ++j)
+    for (int k = part.min.z; k < part.max.z; ++k) {
+      count += section.get(i, j, k) == block;
+    }
+    return false;
+  });
+  return count;
+}
+
+bool World::nearestOfType(glm::ivec3 pos, u_char block, int radius, glm::ivec3& found) const {
+  struct Candidate {
+    int lower_bound; // squared distance from pos to the closest point of the part
+    const Section* section;
+    Box part;
+    glm::ivec3 origin;
+  };
+  auto distance2 = [](glm::ivec3 d) { return d.x * d.x + d.y * d.y + d.z * d.z; };
+
+  std::vector<Candidate> candidates;
+  Box reach {pos - glm::ivec3(radius), pos + glm::ivec3(radius + 1)};
+  forSections(*this, reach, block, [&](const Section& section, const Box& part, glm::ivec3 origin) {
+    Box world_part = part.offset(origin);
+    glm::ivec3 closest = glm::clamp(pos, world_part.min, world_part.max - glm::ivec3(1));
+    int lower_bound = distance2(closest - pos);
+    if (lower_bound <= radius * radius) {
+      candidates.push_back({lower_bound, &section, part, origin});
+    }
+    return false;
+  });
+  std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+    return a.lower_bound < b.lower_bound;
+  });
+
+  // nearest section first, stop once no section left can beat the best so far
+  int best = radius * radius + 1;
+  for (const Candidate& candidate : candidates) {
+    if (candidate.lower_bound >= best) {
+      break;
+    }
+    const Box& part = candidate.part;
+    for (int i = part.min.x; i < part.max.x; ++i)
+    for (int j = part.min.y; j < part.max.y; ++j)
+    for (int k = part.min.z; k < part.max.z; ++k) {
+      glm::ivec3 p = candidate.origin + glm::ivec3(i, j, k);
+      int d = distance2(p - pos);
+      if (d < best && candidate.section->get(i, j, k) == block) {
+        best = d;
+        found = p;
+      }
+    }
+  }
+  return best <= radius * radius;
+}
@@ -2,6 +2,9 @@
 
 #include "Terrain.h"
 #include "Chunk.h"
+#include "FarField.h"
+#include "Water.h"
+#include "Scheduler.h"
 
 #include <glm/gtx/hash.hpp>
 #include <glm/gtc/integer.hpp>
@@ -10,64 +13,235 @@
 #include <vector>
 #include <unordered_map>
 #include <algorithm>
+#include <functional>
 
 
 struct Player;
 
+/// one block write to a generated chunk, as recorded in World::_journal
+struct BlockChange {
+  glm::ivec3 position;
+  u_char old_block;
+  u_char new_block;
+  uint64_t version; // Chunk::_version right after the write and the relighting it caused
+};
+
+/// everything that changed between two World::publish calls
+struct Changes {
+  std::vector<BlockChange> blocks;
+  std::vector<Box> regions; // bulk edits: any block inside may have changed
+
+  bool empty() const { return blocks.empty() && regions.empty(); }
+
+  void clear() {
+    blocks.clear();
+    regions.clear();
+  }
+};
+
+/// the instances of one chunk in the buffer World::build filled, drawn with the chunk's origin
+struct Draw {
+  glm::ivec2 origin; // the chunk's first block in x and z
+  size_t first;
+  size_t count;
+};
+
+/// blocks lifted out of the world by World::copy
+struct Clipboard {
+  glm::ivec3 size {0, 0, 0};
+  std::vector<u_char> blocks;
+
+  u_char& at(int i, int j, int k) { return blocks[(i * size.y + j) * size.z + k]; }
+  u_char at(int i, int j, int k) const { return blocks[(i * size.y + j) * size.z + k]; }
+};
+
 struct World {
   std::unordered_map<glm::ivec2, Chunk*> _chunks;
   std::vector<glm::ivec2> _active_set; // invariant: in increasing distance from the player
   glm::ivec2 _player_chunk_index;
 
+  uint64_t _tick = 0; // bumped every time the active set changes, stamps Chunk::_last_used
+  int _retention_distance = RETENTION_DISTANCE;
+  size_t _memory_budget = CHUNK_MEMORY_BUDGET;
+  size_t _evictions = 0;
+  size_t _resident = 0; // sum of Chunk::_counted over _chunks, see account
+
+  /// block writes to generated chunks since the last publish, in the order they happened.
+  ///   generation of a chunk's own terrain is not recorded, only writes once it is Generated
+  using Subscriber = std::function<void(const Changes&)>;
+  Changes _journal;
+  std::vector<Subscriber> _subscribers;
+
+  /// summaries of every region that has had a chunk loaded, see RegionSummary. never shrinks,
+  /// chunks point into it so entries must not move; an unordered_map keeps its nodes where they are
+  mutable std::unordered_map<glm::ivec2, RegionSummary> _regions;
+
+  /// a coarse copy of every chunk that has been meshed, refreshed on every mesh and kept past eviction
+  FarField _far_field;
+
+  /// flowing water, woken by writes next to liquids and stepped by the main loop
+  Water _water;
+
+  /// block updates due at later ticks, and random ticks around the player
+  Scheduler _updates;
+
   World(Player& player);
 
+  /// get every batch of changes from now on. with no subscribers nothing is recorded
+  void subscribe(Subscriber subscriber) {
+    _subscribers.emplace_back(std::move(subscriber));
+  }
+
+  /// hand this frame's changes to every subscriber and start a new batch
+  void publish();
+
+  /// blocks changed: the sections of built chunks with a face they touch need meshing again, see remesh.
+  ///   only the chunks the box is in are marked, their neighbours find out from their edges
+  void invalidate(Box box);
+  void invalidate(glm::ivec3 block) { invalidate(Box{block, block + glm::ivec3(1)}); }
+
+  /// mesh the dirty sections of every built chunk in the active set, right now: an edit shows the frame it is made.
+  ///   sections next to a neighbour whose edge changed since the last mesh are dirty too.
+  /// then pick the level of detail of each of them by distance, and make up to LOD_MESHES_PER_FRAME of the
+  /// level meshes and skirts that are missing or out of date, see Lod.h
+  void remesh();
+
+  /// bulk edits. the box is split by chunk and section, chunks that are not loaded are skipped,
+  /// and each edit is one region in the journal rather than a change per block
+  void fill(Box box, u_char block);
+  void replace(Box box, u_char from, u_char to);
+  void sphere(glm::ivec3 center, int radius, u_char block);
+  Clipboard copy(Box box) const;
+  void paste(const Clipboard& clipboard, glm::ivec3 at);
+
+  /// spatial queries over loaded chunks, answered from the summaries where they can be: a region,
+  /// chunk or section that cannot hold block is skipped whole, and a section the box covers
+  /// is counted without reading its voxels. unloaded chunks hold nothing
+  bool anyOfType(Box box, u_char block) const;
+  size_t countInBox(Box box, u_char block) const;
+  /// the closest block of that type at most radius away (straight line), false if there is none
+  bool nearestOfType(glm::ivec3 pos, u_char block, int radius, glm::ivec3& found) const;
+
+  /// the summary of a region, rebuilt first if a chunk in it changed. main thread only, like writes
+  const RegionSummary& summary(glm::ivec2 region_index) const;
+
+  /// a / b rounded down, so every cell of b is the same size either side of 0, b > 0
+  static int floorDiv(int a, int b) {
+    return a / b - (a % b < 0);
+  }
+
+  static glm::ivec2 toRegion(glm::ivec2 chunk_index) {
+    return glm::ivec2(floorDiv(chunk_index.x, SUMMARY_REGION_CHUNKS), floorDiv(chunk_index.y, SUMMARY_REGION_CHUNKS));
+  }
+
   void handleTick(Player& player);
 
   void updateActiveSet(Player& player);
 
-  u_char& operator()(int i, int j, int k) {
-    auto good_mod = [](int x, int y) { return (y + (x%y)) % y; };
+  /// every Chunk comes from here and goes back here on eviction
+  static SlabPool<Chunk, 64 * 1024>& chunkPool() {
+    static SlabPool<Chunk, 64 * 1024> pool;
+    return pool;
+  }
+
+  /// make an empty chunk, or load it back from disk if it was evicted after being modified
+  Chunk* create(glm::ivec2 chunk_index);
+
+  /// merge ground generated off-thread into a chunk
+  void installGround(glm::ivec2 chunk_index, Column&& column);
+
+  /// point a new chunk and the chunks around it at each other, and count which of them are generated
+  void link(glm::ivec2 chunk_index, Chunk* chunk);
+  /// the reverse of link, before a chunk goes back to the pool
+  void unlink(Chunk* chunk);
 
-    int di = good_mod(i, CHUNK_SIZE);
-    int dk = good_mod(k, CHUNK_SIZE);
+  /// free chunks outside the retention distance, least recently used first, until under the memory budget.
+  ///   workers only ever hold snapshots, so this can run while they are busy
+  void evict();
+
+  u_char operator()(int i, int j, int k) const {
+    glm::ivec3 local = toLocal({i, j, k});
+    int di = local.x;
+    int dk = local.z;
     auto chunk_index = toChunk({i, j, k});
     assert (hasChunk(chunk_index));
-    return _chunks.at(chunk_index)->data.at(di).at(j).at(dk);
+    assert (j >= 0 && j < CHUNK_HEIGHT);
+    return _chunks.at(chunk_index)->get(di, j, dk);
   }
 
-  u_char& forceGet(int i, int j, int k) {
-    auto good_mod = [](int x, int y) { return (y + (x%y)) % y; };
-
-    int di = good_mod(i, CHUNK_SIZE);
-    int dk = good_mod(k, CHUNK_SIZE);
+  void set(int i, int j, int k, u_char block) {
+    glm::ivec3 local = toLocal({i, j, k});
+    int di = local.x;
+    int dk = local.z;
     auto chunk_index = toChunk({i, j, k});
-    if (not hasChunk(chunk_index)) {
-      _chunks.emplace(chunk_index, new Chunk());
+    assert (hasChunk(chunk_index));
+    assert (j >= 0 && j < CHUNK_HEIGHT);
+    Chunk* chunk = _chunks.at(chunk_index);
+    u_char old_block = chunk->get(di, j, dk);
+    if (old_block == block) {
+      return;
+    }
+    chunk->set(di, j, dk, block);
+    if (chunk->_state >= Chunk::State::Generated) {
+      Light::update(*this, {{i, j, k}});
+      chunk->_modified = true;
+      if (not _subscribers.empty()) {
+        _journal.blocks.push_back({{i, j, k}, old_block, block, chunk->_version});
+      }
+      _water.wake(*this, {i, j, k});
+      _updates.blockChanged(*this, {i, j, k}, old_block);
     }
-    return _chunks.at(chunk_index)->data.at(di).at(j).at(dk);
+    account(chunk);
   }
 
-  u_char operator()(int i, int j, int k) const {
-    auto good_mod = [](int x, int y) { return (y + (x%y)) % y; };
+  /// set every block in writes, in order, and relight once for all of them
+  void setBlocks(const std::vector<std::pair<glm::ivec3, u_char>>& writes);
 
-    int di = good_mod(i, CHUNK_SIZE);
-    int dk = good_mod(k, CHUNK_SIZE);
+  /// set, creating the chunk if it does not exist yet
+  void forceSet(int i, int j, int k, u_char block) {
     auto chunk_index = toChunk({i, j, k});
-    assert (hasChunk(chunk_index));
-    return _chunks.at(chunk_index)->data.at(di).at(j).at(dk);
+    if (not hasChunk(chunk_index)) {
+      create(chunk_index);
+    }
+    set(i, j, k, block);
   }
 
-  void build(std::vector<Instance>& instances);
-  void build_water(std::vector<Instance>& instances);
+  /// the instances of every built chunk in the active set, and where each chunk's run of them is.
+  ///   with visible, only the sections in it (see Visibility::visible)
+  ///   with eye, only the directions of each section's faces that can face it (see Visibility::facing)
+  void build(std::vector<Instance>& instances, std::vector<Draw>& draws, const Visibility::Sections* visible = nullptr,
+             const glm::vec3* eye = nullptr);
+  void build_water(std::vector<Instance>& instances, std::vector<Draw>& draws, const Visibility::Sections* visible = nullptr,
+                   const glm::vec3* eye = nullptr);
+
+  /// what build and build_water share: the terrain instances or the water ones of every visible section
+  void collect(bool water, std::vector<Instance>& instances, std::vector<Draw>& draws,
+               const Visibility::Sections* visible, const glm::vec3* eye) const;
+
+  /// mesh a chunk right here, snapshot and install in one go. only the given sections if it is built already
+  void buildChunk(glm::ivec2 chunk_index, uint32_t sections = Column::ALL_SECTIONS);
+
+  /// mesh a level of detail of a built chunk and its skirts right here
+  void buildLod(glm::ivec2 chunk_index, int level);
 
-  void buildChunk(glm::ivec2 chunk_index);
+  /// versions of a chunk and of the edges facing it of its neighbours at +x, +z, -x, -z, 0 where one is not loaded
+  std::array<uint64_t, 5> versions(glm::ivec2 chunk_index) const;
+
+  /// copy-on-write view of a generated chunk and its neighbours' edges, safe to mesh on another thread
+  MeshJob snapshot(glm::ivec2 chunk_index) const;
+
+  /// take a mesh unless the chunk or a neighbour's edge changed since its snapshot or the chunk was evicted,
+  /// and refresh the chunk's far field copy with what the mesh shows.
+  ///   returns false for a stale result, which is dropped; the chunk keeps its state and gets rebuilt
+  bool install(MeshResult& result);
 
   bool isAir(int i, int j, int k) const {
     if (j >= 0 && j < CHUNK_HEIGHT) {
-      if (hasChunk(toChunk(glm::ivec3(i, 0, k)))) {
-        // loaded chunk
-        auto block = operator()(i, j, k);
-        return block == 0;
+      auto chunk_index = toChunk(glm::ivec3(i, 0, k));
+      if (hasChunk(chunk_index)) {
+        // loaded chunk, answered from its occupancy masks
+        glm::ivec3 local = toLocal({i, j, k});
+        return _chunks.at(chunk_index)->isAir(local.x, j, local.z);
       } else {
         // unloaded chunk
         return true;
@@ -82,7 +256,7 @@ struct World {
       if (hasChunk(toChunk(glm::ivec3(i, 0, k)))) {
         // loaded chunk
         auto block = operator()(i, j, k);
-        return block == Terrain::WATER;
+        return Terrain::has(block, Terrain::LIQUID);
       } else {
         // unloaded chunk
         return true;
@@ -96,8 +270,15 @@ struct World {
     return glm::round(pos);
   }
 
+  /// the chunk a block is in, rounded down so chunks on the negative side are as wide as the rest
   static glm::ivec2 toChunk(glm::ivec3 block) {
-    return glm::ivec2(block.x / CHUNK_SIZE, block.z / CHUNK_SIZE);
+    return glm::ivec2(floorDiv(block.x, CHUNK_SIZE), floorDiv(block.z, CHUNK_SIZE));
+  }
+
+  /// a block in the coordinates of the chunk toChunk puts it in
+  static glm::ivec3 toLocal(glm::ivec3 block) {
+    glm::ivec2 chunk_index = toChunk(block);
+    return {block.x - chunk_index.x * CHUNK_SIZE, block.y, block.z - chunk_index.y * CHUNK_SIZE};
   }
 
   bool hasChunk(glm::ivec2 chunk_index) const {
@@ -111,4 +292,80 @@ struct World {
   Chunk* chunk(glm::ivec2 chunk_index) {
     return _chunks.at(chunk_index);
   }
+
+  /// the blocks of chunk_index, in world coordinates
+  static Box chunkBox(glm::ivec2 chunk_index) {
+    glm::ivec3 origin {chunk_index.x * CHUNK_SIZE, 0, chunk_index.y * CHUNK_SIZE};
+    return {origin, origin + glm::ivec3(CHUNK_SIZE, CHUNK_HEIGHT, CHUNK_SIZE)};
+  }
+
+  /// call f(chunk, part, origin) for every loaded chunk box reaches, part in chunk coordinates
+  /// and origin the chunk's first block in the world. f returns whether it changed a block.
+  ///   chunks it changed get a new version and are relit with their neighbours afterwards,
+  ///   and box goes into the journal once if any did
+  template <typename F>
+  void edit(Box box, F f) {
+    box = box.intersect({glm::ivec3(box.min.x, 0, box.min.z), glm::ivec3(box.max.x, CHUNK_HEIGHT, box.max.z)});
+    if (box.empty()) {
+      return;
+    }
+    glm::ivec2 first = toChunk(box.min);
+    glm::ivec2 last = toChunk(box.max - glm::ivec3(1));
+    bool changed = false;
+    std::vector<glm::ivec2> lit;
+    for (int x = first.x; x <= last.x; ++x)
+    for (int z = first.y; z <= last.y; ++z) {
+      auto it = _chunks.find({x, z});
+      if (it == _chunks.end()) {
+        continue;
+      }
+      Chunk* chunk = it->second;
+      Box chunk_box = chunkBox({x, z});
+      if (not f(*chunk, box.intersect(chunk_box).offset(-chunk_box.min), chunk_box.min)) {
+        continue;
+      }
+      changed = true;
+      chunk->touch();
+      if (chunk->_state >= Chunk::State::Generated) {
+        chunk->_modified = true;
+      }
+      account(chunk);
+      if (chunk->_state >= Chunk::State::Generated) {
+        lit.emplace_back(x, z);
+      }
+    }
+    if (not lit.empty()) {
+      Light::relight(*this, lit);
+    }
+    if (not changed) {
+      return;
+    }
+    if (not _subscribers.empty()) {
+      _journal.regions.push_back(box);
+    }
+    _water.wake(*this, box);
+    _updates.boxChanged(*this, box);
+  }
+
+  /// bytes of voxel storage held by all loaded chunks
+  size_t bytes() const {
+    size_t total = 0;
+    for (const auto& [chunk_index, chunk] : _chunks) {
+      total += chunk->bytes();
+    }
+    return total;
+  }
+
+  /// a chunk may have grown or shrunk: move the running total by the difference.
+  ///   everything that writes to a loaded chunk or its instances calls this afterwards
+  void account(Chunk* chunk) {
+    size_t bytes = chunk->residentBytes();
+    _resident += bytes - chunk->_counted;
+    chunk->_counted = bytes;
+  }
+
+  /// bytes held by all loaded chunks, including their instances
+  size_t residentBytes() const {
+    return _resident;
+  }
 };
@@ -10,17 +10,16 @@
 #include "Terrain.h"
 #include "Str.h"
 #include "Profiler.h"
+#include "MeshWorkers.h"
 
 #include <iostream>
 #include <vector>
 
 #include <GLFW/glfw3.h>
-#include <glm/gtx/rotate_vector.hpp>
 
 #include <future>
 #include <deque>
 
-constexpr bool SHADOWS = false;
 constexpr bool PROFILING = true;
 
 int main() {
@@ -107,9 +106,11 @@ int main() {
 
   std::vector<Instance> instances;
   std::vector<Instance> water_instances;
+  std::vector<Draw> draws;
+  std::vector<Draw> water_draws;
 
-  world.build(instances);
-  world.build_water(water_instances);
+  world.build(instances, draws);
+  world.build_water(water_instances, water_draws);
 
   GLuint worldVAO, waterVAO;
   struct VBO_ {
@@ -135,17 +136,13 @@ int main() {
 
     glBufferData(GL_ARRAY_BUFFER, sizeof(Instance) * instances.size(), instances.data(), GL_STATIC_DRAW);
     glEnableVertexAttribArray(1);
-    glVertexAttribPointer(    1, 3, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)0);
+    glVertexAttribIPointer(   1, 1, GL_UNSIGNED_INT, sizeof(Instance), (void*)0);
     glVertexAttribDivisor(    1, 1);
 
     glEnableVertexAttribArray(2);
-    glVertexAttribIPointer(   2, 1, GL_UNSIGNED_INT, sizeof(Instance), (void*)(sizeof(glm::vec3)));
+    glVertexAttribIPointer(   2, 1, GL_UNSIGNED_INT, sizeof(Instance), (void*)(sizeof(GLuint)));
     glVertexAttribDivisor(    2, 1);
 
-    glEnableVertexAttribArray(3);
-    glVertexAttribIPointer(   3, 1, GL_UNSIGNED_INT, sizeof(Instance), (void*)(sizeof(glm::vec3) + sizeof(GLuint)));
-    glVertexAttribDivisor(    3, 1);
-
   // WATER VBO
   glGenVertexArrays(1, &waterVAO);
 	glBindVertexArray(waterVAO);
@@ -164,45 +161,44 @@ int main() {
 
     glBufferData(GL_ARRAY_BUFFER, sizeof(Instance) * water_instances.size(), water_instances.data(), GL_STATIC_DRAW);
     glEnableVertexAttribArray(1);
-    glVertexAttribPointer(    1, 3, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)0);
+    glVertexAttribIPointer(   1, 1, GL_UNSIGNED_INT, sizeof(Instance), (void*)0);
     glVertexAttribDivisor(    1, 1);
 
     glEnableVertexAttribArray(2);
-    glVertexAttribIPointer(   2, 1, GL_UNSIGNED_INT, sizeof(Instance), (void*)(sizeof(glm::vec3)));
+    glVertexAttribIPointer(   2, 1, GL_UNSIGNED_INT, sizeof(Instance), (void*)(sizeof(GLuint)));
     glVertexAttribDivisor(    2, 1);
 
-    glEnableVertexAttribArray(3);
-    glVertexAttribIPointer(   3, 1, GL_UNSIGNED_INT, sizeof(Instance), (void*)(sizeof(glm::vec3) + sizeof(GLuint)));
-    glVertexAttribDivisor(    3, 1);
-
   ShaderSource program_sources;
   program_sources.vertex = world_vertex_shader;
   program_sources.geometry = world_geometry_shader;
   program_sources.fragment = world_fragment_shader;
 
-  GLuint program_id = CreateProgram(program_sources, {"vertex_position", "instance_offset", "direction", "texture_index"});
+  GLuint program_id = CreateProgram(program_sources, {"vertex_position", "face", "shade"});
   glUseProgram(program_id);
 
   struct {
     GLint projection = 0;
     GLint view = 0;
     GLint light_pos = 0;
-    GLint light_space = 0;
     GLint wireframe = 0;
     GLint bases = 0;
     GLint offs = 0;
+    GLint liquids = 0;
+    GLint chunk_origin = 0;
 	} uniform, water_unifrom;
 
   uniform.projection   = glGetUniformLocation(program_id, "projection");
   uniform.view         = glGetUniformLocation(program_id, "view");
-  uniform.light_space  = glGetUniformLocation(program_id, "light_space");
   uniform.light_pos    = glGetUniformLocation(program_id, "light_position");
   uniform.wireframe    = glGetUniformLocation(program_id, "wireframe");
   uniform.bases        = glGetUniformLocation(program_id, "base_colors");
   uniform.offs         = glGetUniformLocation(program_id, "off_colors");
+  uniform.liquids      = glGetUniformLocation(program_id, "liquids");
+  uniform.chunk_origin = glGetUniformLocation(program_id, "chunk_origin");
 
-  std::vector<glm::vec4> base_colors (10, glm::vec4(0, 0, 0, 1));
-  std::vector<glm::vec4> off_colors  (10, glm::vec4(0, 0, 0, 1));
+  // colours and which blocks are liquid come from the block registry
+  std::vector<glm::vec4> base_colors;
+  std::vector<glm::vec4> off_colors;
 
   Terrain::setColors(base_colors, off_colors);
 
@@ -212,72 +208,90 @@ int main() {
   water_program_sources.geometry = world_geometry_shader;
   water_program_sources.fragment = world_fragment_shader;
 
-  GLuint water_program_id = CreateProgram(water_program_sources, {"vertex_position", "instance_offset", "direction", "texture_index"});
+  GLuint water_program_id = CreateProgram(water_program_sources, {"vertex_position", "face", "shade"});
   glUseProgram(water_program_id);
 
-  water_unifrom.projection = glGetUniformLocation(program_id, "projection");
-  water_unifrom.view              = glGetUniformLocation(program_id, "view");
-  water_unifrom.light_space       = glGetUniformLocation(program_id, "light_space");
-  water_unifrom.light_pos         = glGetUniformLocation(program_id, "light_position");
+  water_unifrom.projection   = glGetUniformLocation(water_program_id, "projection");
+  water_unifrom.view         = glGetUniformLocation(water_program_id, "view");
+  water_unifrom.light_pos    = glGetUniformLocation(water_program_id, "light_position");
+  water_unifrom.wireframe    = glGetUniformLocation(water_program_id, "wireframe");
+  water_unifrom.bases        = glGetUniformLocation(water_program_id, "base_colors");
+  water_unifrom.offs         = glGetUniformLocation(water_program_id, "off_colors");
+  water_unifrom.liquids      = glGetUniformLocation(water_program_id, "liquids");
+  water_unifrom.chunk_origin = glGetUniformLocation(water_program_id, "chunk_origin");
+
+  // instances are in chunk coordinates, so every chunk is a draw of its own with its origin as a uniform.
+  // there is no base instance before GL 4.2: the instance attributes are pointed at the chunk's run instead
+  auto draw_chunks = [&](const std::vector<Draw>& chunk_draws, GLint chunk_origin) {
+    for (const Draw& draw : chunk_draws) {
+      glVertexAttribIPointer(1, 1, GL_UNSIGNED_INT, sizeof(Instance), (void*)(draw.first * sizeof(Instance)));
+      glVertexAttribIPointer(2, 1, GL_UNSIGNED_INT, sizeof(Instance), (void*)(draw.first * sizeof(Instance) + sizeof(GLuint)));
+      glUniform2i(chunk_origin, draw.origin.x, draw.origin.y);
+      glDrawElementsInstanced(GL_TRIANGLES, faces.size() * 3, GL_UNSIGNED_INT, NULL, draw.count);
+    }
+  };
 
+  // uniforms belong to a program: both get the registry's colours and liquids
+  glUniform4fv(water_unifrom.bases, base_colors.size(), (const GLfloat*)base_colors.data());
+  glUniform4fv(water_unifrom.offs, off_colors.size(), (const GLfloat*)off_colors.data());
+  glUniform1ui(water_unifrom.liquids, Terrain::mask(Terrain::LIQUID));
 
   glUseProgram(program_id);
 
   auto update_bases = [&](){
-    glUniform4fv(uniform.bases, 10, (const GLfloat*)base_colors.data());
+    glUniform4fv(uniform.bases, base_colors.size(), (const GLfloat*)base_colors.data());
   };
   update_bases();
 
   auto update_offs = [&](){
-    glUniform4fv(uniform.offs, 10, (const GLfloat*)off_colors.data());
+    glUniform4fv(uniform.offs, off_colors.size(), (const GLfloat*)off_colors.data());
   };
   update_offs();
 
+  glUniform1ui(uniform.liquids, Terrain::mask(Terrain::LIQUID));
+
   glm::vec4 light_position {0, 1000, 0, 1};
 
-  // Setup framebuffer for depth
-  const unsigned int SHADOW_WIDTH = 10000;
-  const unsigned int SHADOW_HEIGHT = 10000;
-
-  GLuint depthFBO;
-  glGenFramebuffers(1, &depthFBO);
-
-  // setup depth texture
-  GLuint depthMapTex;
-  glGenTextures(1, &depthMapTex); 
-  glBindTexture(GL_TEXTURE_2D, depthMapTex);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, 
-      SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-  // settings of texture
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-  // glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  // glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-  
-  // bind shadow framebuffer
-  glBindFramebuffer(GL_FRAMEBUFFER, depthFBO);
-  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMapTex, 0);
-  glDrawBuffer(GL_NONE);
-  glReadBuffer(GL_NONE);
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);  
+  /// Change Feed ===------------------------------------------------------------------------===///
+
+  // the sections with a face an edit touches get meshed again, in the same frame by world.remesh
+  world.subscribe([&world](const Changes& changes) {
+    for (const BlockChange& change : changes.blocks) {
+      world.invalidate(change.position);
+    }
+    for (const Box& region : changes.regions) {
+      world.invalidate(region);
+    }
+  });
 
   /// Workers ===----------------------------------------------------------------------------===///
 
   std::atomic<bool> workers_running = true;
 
-  std::atomic<std::pair<Chunk*, glm::ivec2>*> ground_gen_req { nullptr };
+  // the ground worker generates into a column of its own and never touches a live chunk,
+  // the main thread merges the column in when the job comes back
+  struct GroundJob {
+    glm::ivec2 chunk_index;
+    Column column;
+  };
+  std::atomic<GroundJob*> ground_gen_req { nullptr };  // main -> worker
+  std::atomic<GroundJob*> ground_gen_done { nullptr }; // worker -> main
+  bool ground_gen_busy = false;
 
   auto ground_gen_worker = std::thread([&]() {
     while (workers_running) {
-      if (ground_gen_req) {
-        auto& [chunk, chunk_index] = *ground_gen_req;
-        TerrainGen::ground(chunk, chunk_index);
-        delete ground_gen_req;
+      if (GroundJob* job = ground_gen_req.exchange(nullptr)) {
+        TerrainGen::ground(job->column, job->chunk_index);
+        ground_gen_done = job;
+      } else {
+        std::this_thread::yield();
       }
-      ground_gen_req = nullptr;
     }
   });
 
+  // mesh workers read snapshots only, and the main thread installs what they give back
+  MeshWorkers mesh_workers;
+
   /// Render Loop ===------------------------------------------------------------------------===///
 
   // once we're ok to start rendering, disable the mouse
@@ -323,67 +337,89 @@ int main() {
 
     if constexpr(PROFILING) { pr.event("  handle movement and update ticks"); }
 
-    bool have_sent_to_worker = false; // only send to worker once a frame
+    if (world._water.update(world, delta_time)) {
+      if constexpr(PROFILING) { pr.event("  flow water"); }
+    }
+    if (world._updates.update(world, delta_time)) {
+      if constexpr(PROFILING) { pr.event("  block updates and random ticks"); }
+    }
+
+    world.publish();
+    if constexpr(PROFILING) { pr.event("  publish block changes"); }
+
+    world.remesh();
+    if constexpr(PROFILING) { pr.event("  remesh edited sections"); }
+
+    if (GroundJob* job = ground_gen_done.exchange(nullptr)) {
+      // the chunk may have been evicted, or evicted and loaded back from disk, while the worker ran
+      if (world.hasChunk(job->chunk_index) && world.chunk(job->chunk_index)->_state == Chunk::State::Exists) {
+        world.installGround(job->chunk_index, std::move(job->column));
+      }
+      delete job;
+      ground_gen_busy = false;
+      if constexpr(PROFILING) { pr.event("  install generated ground"); }
+    }
+
+    if (mesh_workers.drain(world)) {
+      if constexpr(PROFILING) { pr.event("  install meshes"); }
+    }
+
     for (const glm::ivec2& chunk_index : world._active_set) {
       if (not world.hasChunk(chunk_index)) {
-        world._chunks.emplace(chunk_index, new Chunk());
+        world.create(chunk_index);
         if constexpr(PROFILING) { pr.event("  allocate a new chunk"); }
       }
+      Chunk* chunk = world.chunk(chunk_index);
 
-      auto is_surroundings_generated = [&]() {
-        for (int i = -1; i <= 1; ++i)
-        for (int k = -1; k <= 1; ++k) {
-          glm::ivec2 curr_index = chunk_index + glm::ivec2{i, k};
-
-          if (not world.hasChunk(curr_index) 
-            || world.chunk(curr_index)->_state < Chunk::State::Generated) {
-            return false;
-          }
+      // meshing goes to the workers, so it does not use up this frame's step
+      if (chunk->_state < Chunk::State::Built && chunk->surroundingsGenerated()) {
+        if (mesh_workers.submit(world, chunk_index)) {
+          if constexpr(PROFILING) { pr.event("  send chunk to mesh workers"); }
         }
-
-        return true;
-      };
-
-      if (world.hasChunk(chunk_index) 
-          && world.chunk(chunk_index)->_state < Chunk::State::Built 
-          && is_surroundings_generated()) {
-        world.buildChunk(chunk_index);
-        if constexpr(PROFILING) { pr.event("  build instances for a chunk"); }
-        break;
+        continue;
       }
 
-      if (world.chunk(chunk_index)->_state == Chunk::State::Exists && not have_sent_to_worker) {
-        Chunk* chunk = world.chunk(chunk_index);
-        if (not ground_gen_req) {
-          ground_gen_req = new std::pair<Chunk*, glm::ivec2>(chunk, chunk_index);
-          have_sent_to_worker = true;
-          break;
+      if (chunk->_state == Chunk::State::Exists) {
+        if (not ground_gen_busy) {
+          ground_gen_busy = true;
+          ground_gen_req = new GroundJob{chunk_index};
           if constexpr(PROFILING) { pr.event("  send chunk to generate_ground_worker"); }
+          break;
         } else {
           if constexpr(PROFILING) { pr.event("  generate_ground_worker was busy"); }
         }
       }
 
-      if (world.chunk(chunk_index)->_state == Chunk::State::Generated_Ground) {
+      if (chunk->_state == Chunk::State::Generated_Ground) {
         TerrainGen::caves(world, chunk_index);
         if constexpr(PROFILING) { pr.event("  generate caves"); }
         break;
       }
 
-      if (world.chunk(chunk_index)->_state == Chunk::State::Generated_Caves) {
+      if (chunk->_state == Chunk::State::Generated_Caves) {
         TerrainGen::trees(world, chunk_index);
         if constexpr(PROFILING) { pr.event("  generate trees"); }
         break;
       }
     }
 
+    world.evict();
+    if constexpr(PROFILING) { pr.event("  evict chunks"); }
+
     if constexpr(PROFILING) { pr.event("handle updates"); }
 
     /// Build Instances ===-------------------------------------------------------===///
     glUseProgram(program_id);
     glBindVertexArray(worldVAO);
 
-    world.build(instances);
+    Visibility::Sections visible;
+    if constexpr(CAVE_CULLING) {
+      visible = Visibility::visible(world, player.camera.eye(), player.camera.look());
+      if constexpr(PROFILING) { pr.event("cull sections"); }
+    }
+
+    glm::vec3 eye = player.camera.eye();
+    world.build(instances, draws, CAVE_CULLING ? &visible : nullptr, BACK_FACE_CULLING ? &eye : nullptr);
     glBindBuffer(GL_ARRAY_BUFFER, VBO.instances_buffer);
     glBufferData(GL_ARRAY_BUFFER, sizeof(Instance) * instances.size(), instances.data(), GL_STATIC_DRAW);
 
@@ -393,7 +429,6 @@ int main() {
     float aspect = static_cast<float>(window.width()) / window.height();
     glm::mat4 projection_matrix(0);
     glm::mat4 view_matrix(0);
-    glm::mat4 light_space_matrix(0);
 
     glUseProgram(program_id);
     glEnable(GL_CULL_FACE);
@@ -402,36 +437,6 @@ int main() {
     glEnable(GL_DEPTH_TEST);
 		glDepthFunc(GL_LESS);
 
-    /// Render to Shadow Texture ===----------------------------------------------===///
-    if (SHADOWS) {
-      // Set rendering options
-      glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-      glBindFramebuffer(GL_FRAMEBUFFER, depthFBO);
-      // glBindFramebuffer(GL_FRAMEBUFFER, 0);
-      glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
-      
-      // Compute uniforms
-      glm::vec4 light_offset = glm::rotate(glm::vec4(0, 128 + 60, 0, 0), 0.5f * glm::sin((float)glfwGetTime()/5), glm::vec3(1, 0, 1));
-      light_position = glm::vec4(glm::vec3{player.head().x, 0, player.head().z} + glm::vec3(light_offset), 1);
-
-      light_space_matrix = glm::mat4(0);
-      projection_matrix = glm::ortho(-400.0f, 400.0f, -400.0f, 400.0f, 50.f, 200.0f);
-  		// projection_matrix = glm::perspective(glm::radians(120.0f), aspect, 5.f, 1000.0f);
-      view_matrix = glm::lookAt(glm::vec3(light_position), player.head(), glm::vec3(1, 0, 0));
-      // view_matrix = player.camera.get_view_matrix();
-      
-      // Pass uniforms in.
-      glUniformMatrix4fv(uniform.projection, 1, GL_FALSE, &projection_matrix[0][0]);
-      glUniformMatrix4fv(uniform.view,       1, GL_FALSE, &view_matrix[0][0]);
-      glUniformMatrix4fv(uniform.light_space,1, GL_FALSE, &light_space_matrix[0][0]);
-      glUniform4fv(      uniform.light_pos,  1, &light_position[0]);
-      glUniform1i(       uniform.wireframe,  wireframe_mode);
-
-      glDrawElementsInstanced(GL_TRIANGLES, faces.size() * 3, GL_UNSIGNED_INT, NULL, instances.size());
-
-      if constexpr(PROFILING) { pr.event("render shadow"); }
-    }
-
     /// Render to Screen ===-----------------------------------------------------===///
     // Set rendering options
     glViewport(0, 0, window.width(), window.height());
@@ -441,19 +446,16 @@ int main() {
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     // Compute uniforms
-    light_space_matrix = projection_matrix * view_matrix;
 		projection_matrix = glm::perspective(glm::radians(45.0f), aspect, 0.5f, 1000.0f);
     view_matrix = player.camera.get_view_matrix();
 
     // Pass uniforms in.
 		glUniformMatrix4fv(uniform.projection, 1, GL_FALSE, &projection_matrix[0][0]);
 		glUniformMatrix4fv(uniform.view,       1, GL_FALSE, &view_matrix[0][0]);
-		glUniformMatrix4fv(uniform.light_space,1, GL_FALSE, &light_space_matrix[0][0]);
 		glUniform4fv(      uniform.light_pos,  1, &light_position[0]);
     glUniform1i(       uniform.wireframe,  wireframe_mode);
 
-    glBindTexture(GL_TEXTURE_2D, depthMapTex);
-    glDrawElementsInstanced(GL_TRIANGLES, faces.size() * 3, GL_UNSIGNED_INT, NULL, instances.size());
+    draw_chunks(draws, uniform.chunk_origin);
 
 
     glBindVertexArray(waterVAO);
@@ -462,15 +464,16 @@ int main() {
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     
-    glUniformMatrix4fv(uniform.projection, 1, GL_FALSE, &projection_matrix[0][0]);
-    glUniformMatrix4fv(uniform.view,       1, GL_FALSE, &view_matrix[0][0]);
-    glUniformMatrix4fv(uniform.light_space,1, GL_FALSE, &light_space_matrix[0][0]);
+    glUniformMatrix4fv(water_unifrom.projection, 1, GL_FALSE, &projection_matrix[0][0]);
+    glUniformMatrix4fv(water_unifrom.view,       1, GL_FALSE, &view_matrix[0][0]);
+    glUniform4fv(      water_unifrom.light_pos,  1, &light_position[0]);
+    glUniform1i(       water_unifrom.wireframe,  wireframe_mode);
 
-    world.build_water(water_instances);
+    world.build_water(water_instances, water_draws, CAVE_CULLING ? &visible : nullptr, BACK_FACE_CULLING ? &eye : nullptr);
     glBindBuffer(GL_ARRAY_BUFFER, water_VBO.instances_buffer);
     glBufferData(GL_ARRAY_BUFFER, sizeof(Instance) * water_instances.size(), water_instances.data(), GL_STATIC_DRAW);
 
-    glDrawElementsInstanced(GL_TRIANGLES, faces.size() * 3, GL_UNSIGNED_INT, NULL, water_instances.size());
+    draw_chunks(water_draws, water_unifrom.chunk_origin);
 
     if constexpr(PROFILING) { pr.event("render to screen"); }
     
@@ -542,9 +545,18 @@ int main() {
     tr.renderText("FPS: " + str(framerate), window.width() - 300 + tilde_width, 50, 1);
     tr.renderText("~FPS: " + str(moving_framerate), window.width() - 300, 80, 1);
 
-    tr.renderText(str(world._chunks.size() * CHUNK_HEIGHT * CHUNK_SIZE * CHUNK_SIZE / 1024.f / 1024.f) + " MB", 
+    tr.renderText(str(world.residentBytes() / 1024.f / 1024.f) + " MB", 
         window.width() - 400, window.height()/2, 1, glm::vec4(1));
-    // FIXME: also need to include instances in memory usage heuristics
+    tr.renderText(str(world._evictions) + " evicted", 
+        window.width() - 400, window.height()/2 + 30, 1, glm::vec4(1));
+    tr.renderText(str(world._far_field._chunks.size()) + " explored, " + str(world._far_field.bytesPerChunk()) + " B each",
+        window.width() - 400, window.height()/2 + 60, 1, glm::vec4(1));
+    tr.renderText(str(world._water._active.size()) + " water cells active",
+        window.width() - 400, window.height()/2 + 90, 1, glm::vec4(1));
+    tr.renderText(str(mesh_workers.inFlight()) + " meshing, " + str(mesh_workers._stale) + " stale",
+        window.width() - 400, window.height()/2 + 120, 1, glm::vec4(1));
+    tr.renderText(str(instances.size()) + " quads drawn",
+        window.width() - 400, window.height()/2 + 150, 1, glm::vec4(1));
     
     if constexpr(PROFILING) {
       pr.event("render text");
@@ -573,4 +585,6 @@ int main() {
   workers_running = false;
 
   ground_gen_worker.join();
+  delete ground_gen_req.load();
+  delete ground_gen_done.load();
 }
@@ -2,6 +2,44 @@
 #include "../src/World.h"
 #include "../src/Player.h"
 #include "../src/TerrainGen.h"
+#include "../src/ChunkStore.h"
+#include "../src/MeshWorkers.h"
+#include "../src/Visibility.h"
+#include "../src/Lod.h"
+
+#include <fstream>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <cstring>
+#include <chrono>
+#include <unistd.h>
+
+/// a world of its own for a test: its saves go to a fresh directory called name under the temp dir, the
+/// player starts at at, and the chunks within radius of the player's chunk are created and generated.
+/// a negative radius leaves the world empty
+struct TestWorld {
+  Player p;
+  World w;
+  glm::ivec2 center;
+
+  TestWorld(const char* name, glm::vec3 at, int radius = -1): p(placed(name, at)), w(p), center(World::toChunk(p.blockPosition())) {
+    for (int i = -radius; i <= radius; ++i)
+    for (int k = -radius; k <= radius; ++k) {
+      w.create(center + glm::ivec2(i, k));
+      TerrainGen::chunk(w, center + glm::ivec2(i, k));
+    }
+  }
+
+  static Player placed(const char* name, glm::vec3 at) {
+    ChunkStore::directory = testing::TempDir() + name;
+    std::filesystem::remove_all(ChunkStore::directory);
+    Player p;
+    p.setPos(at);
+    return p;
+  }
+};
 
 
 // TEST(Physics, vertical_cases) {
@@ -129,4 +167,1427 @@ TEST(TerrainGen, carve_set_deterministic) {
   auto set = TerrainGen::carve_set({50, 50});
   auto set2 = TerrainGen::carve_set({50, 50});
   ASSERT_EQ(set, set2);
-}
\ No newline at end of file
+}
+TEST(Chunk, sections_allocate_on_write) {
+  Chunk chunk;
+  ASSERT_EQ(chunk.bytes(), 0u);
+  ASSERT_EQ(chunk.get(3, 100, 3), Terrain::AIR);
+
+  chunk.set(3, 100, 3, Terrain::AIR);
+  ASSERT_EQ(chunk.bytes(), 0u);
+
+  chunk.set(3, 100, 3, Terrain::DIRT);
+  ASSERT_EQ(chunk.get(3, 100, 3), Terrain::DIRT);
+  ASSERT_EQ(chunk.bytes(), sizeof(Section::Storage));
+
+  chunk.set(3, 100, 3, Terrain::AIR);
+  chunk.compact();
+  ASSERT_EQ(chunk.bytes(), 0u);
+  ASSERT_EQ(Section::shared(Terrain::AIR)->blocks.at(Section::index(3, 4, 3)), Terrain::AIR);
+}
+
+TEST(Chunk, generated_memory_grows_with_content) {
+  size_t dense = world._chunks.size() * CHUNK_HEIGHT * CHUNK_SIZE * CHUNK_SIZE;
+  ASSERT_LT(world.bytes(), dense);
+}
+
+TEST(World, evicted_chunks_reload_from_disk) {
+  TestWorld t {"minecraft_saves", {8000, 100, 8000}};
+  Player& p = t.p;
+  World& w = t.w;
+  TerrainGen::spawn(w, p);
+
+  glm::ivec3 block = p.blockPosition() + glm::ivec3(0, 5, 0);
+  glm::ivec2 chunk_index = World::toChunk(block);
+  w.set(block.x, block.y, block.z, Terrain::LEAF);
+
+  // an unmodified chunk is not saved, it is generated again the same, caves and trees included
+  glm::ivec2 untouched = chunk_index + glm::ivec2(0, 3);
+  auto blocks = [&w](glm::ivec2 chunk_index) {
+    std::vector<u_char> blocks;
+    for (int i = 0; i < CHUNK_SIZE; ++i)
+    for (int j = 0; j < CHUNK_HEIGHT; ++j)
+    for (int k = 0; k < CHUNK_SIZE; ++k) {
+      blocks.push_back(w.chunk(chunk_index)->get(i, j, k));
+    }
+    return blocks;
+  };
+  std::vector<u_char> generated = blocks(untouched);
+
+  w._memory_budget = 0;
+  p.setPos(glm::vec3(8000 + 16 * 3 * RETENTION_DISTANCE, 100, 8000));
+  w.handleTick(p);
+  w.evict();
+  ASSERT_FALSE(w.hasChunk(chunk_index));
+  ASSERT_FALSE(w.hasChunk(untouched));
+  ASSERT_GT(w._evictions, 0u);
+
+  w.create(chunk_index);
+  ASSERT_EQ(w.chunk(chunk_index)->_state, Chunk::State::Generated);
+  ASSERT_EQ(w(block.x, block.y, block.z), Terrain::LEAF);
+  w.create(untouched);
+  TerrainGen::chunk(w, untouched);
+  ASSERT_EQ(blocks(untouched), generated);
+
+  // a file cut short or with a block that does not exist reads as never saved, and leaves the chunk it
+  // was read into alone
+  std::string file = ChunkStore::directory + "/" + std::to_string(chunk_index.x) + "." + std::to_string(chunk_index.y) + ".chunk";
+  std::filesystem::resize_file(file, std::filesystem::file_size(file) / 2);
+  Chunk partial;
+  std::vector<Scheduler::Suspended> updates;
+  ASSERT_FALSE(ChunkStore::load(partial, chunk_index, updates));
+  ASSERT_EQ(partial.bytes(), 0u);
+  ASSERT_EQ(partial._state, Chunk::State::Exists);
+
+  ASSERT_TRUE(ChunkStore::save(*w.chunk(chunk_index), chunk_index, {}));
+  {
+    std::fstream corrupt {file, std::ios::binary | std::ios::in | std::ios::out};
+    corrupt.seekp(4 + sizeof(int) + 1); // the first block of the bottom section, uniform or not
+    corrupt.put(char(200));
+  }
+  Chunk corrupt;
+  ASSERT_FALSE(ChunkStore::load(corrupt, chunk_index, updates));
+  ASSERT_EQ(corrupt.bytes(), 0u);
+  ASSERT_EQ(corrupt._state, Chunk::State::Exists);
+
+  // a chunk that cannot be saved is not evicted, its edits would be gone
+  ChunkStore::directory = file + "/cannot_be_a_directory";
+  ASSERT_FALSE(ChunkStore::save(*w.chunk(chunk_index), chunk_index, {}));
+  w.set(block.x, block.y, block.z, Terrain::DIRT);
+  w.evict();
+  ASSERT_TRUE(w.hasChunk(chunk_index));
+  ASSERT_EQ(w(block.x, block.y, block.z), Terrain::DIRT);
+}
+
+TEST(World, neighbour_links_follow_create_and_evict) {
+  TestWorld t("minecraft_neighbours", {12000, 100, 12000});
+  World& w = t.w;
+  Player& p = t.p;
+  TerrainGen::spawn(w, p);
+
+  auto check = [&w]() {
+    for (const auto& [chunk_index, chunk] : w._chunks) {
+      int generated = 0;
+      for (int n = 0; n < 8; ++n) {
+        glm::ivec2 neighbour_index = chunk_index + Chunk::NEIGHBOURS[n];
+        Chunk* neighbour = w.hasChunk(neighbour_index) ? w.chunk(neighbour_index) : nullptr;
+        ASSERT_EQ(chunk->_neighbours[n], neighbour);
+        generated += neighbour && neighbour->_state >= Chunk::State::Generated;
+      }
+      ASSERT_EQ(chunk->_generated_neighbours, generated);
+    }
+  };
+  check();
+  glm::ivec2 center = t.center;
+  ASSERT_TRUE(w.chunk(center)->surroundingsGenerated());
+  ASSERT_FALSE(w.chunk(center + glm::ivec2(RENDER_DISTANCE, 0))->surroundingsGenerated());
+
+  // a fresh chunk next to the edge, then everything far away evicted
+  glm::ivec2 edge = center + glm::ivec2(RENDER_DISTANCE + 1, 0);
+  w.create(edge);
+  check();
+  TerrainGen::chunk(w, edge);
+  check();
+
+  w._memory_budget = 0;
+  p.setPos(glm::vec3(12000 + CHUNK_SIZE * (RENDER_DISTANCE + RETENTION_DISTANCE), 100, 12000));
+  w.handleTick(p);
+  w.evict();
+  ASSERT_GT(w._evictions, 0u);
+  check();
+}
+
+TEST(World, soak_resident_memory_stays_flat) {
+  auto rss = []() {
+    long pages = 0, resident = 0;
+    std::ifstream {"/proc/self/statm"} >> pages >> resident;
+    return resident * sysconf(_SC_PAGESIZE);
+  };
+
+  TestWorld t {"minecraft_soak", {20000, 100, 20000}};
+  Player& p = t.p;
+  World& w = t.w;
+  w._memory_budget = 16 * 1024 * 1024;
+
+  constexpr int chunks_to_fly = 2000;
+  long warm_rss = 0;
+  int generated = 0;
+  for (int step = 0; generated < chunks_to_fly; ++step) {
+    p.setPos(glm::vec3(20000 + step * CHUNK_SIZE, 100, 20000));
+    w.handleTick(p);
+    for (glm::ivec2 chunk_index : w._active_set) {
+      if (not w.hasChunk(chunk_index)) {
+        w.create(chunk_index);
+      }
+      if (w.chunk(chunk_index)->_state < Chunk::State::Generated) {
+        TerrainGen::chunk(w, chunk_index);
+        ++generated;
+      }
+    }
+    w.evict();
+
+    // flat from the point the budget starts evicting
+    if (warm_rss == 0 && w._evictions > 0) {
+      warm_rss = rss();
+    }
+  }
+
+  // the running total is what the chunks hold
+  size_t resident = 0;
+  for (const auto& [chunk_index, chunk] : w._chunks) {
+    resident += chunk->residentBytes();
+  }
+  ASSERT_EQ(w.residentBytes(), resident);
+  ASSERT_LE(w.residentBytes(), w._memory_budget + 2 * RETENTION_DISTANCE * 2 * RETENTION_DISTANCE * sizeof(Chunk));
+  ASSERT_LT(rss(), warm_rss * 1.1);
+}
+
+TEST(Pool, released_slots_are_recycled) {
+  SlabPool<Section::Blocks, 2 * 1024 * 1024> pool;
+  void* a = pool.acquire();
+  pool.release(a);
+  ASSERT_EQ(pool.acquire(), a);
+
+  std::vector<void*> slots;
+  for (size_t i = 0; i < 3 * decltype(pool)::SLOTS_PER_SLAB; ++i) {
+    slots.emplace_back(pool.acquire());
+  }
+  size_t slabs = pool._slabs.size();
+  for (void* slot : slots) {
+    pool.release(slot);
+  }
+  for (size_t i = 0; i < slots.size(); ++i) {
+    pool.acquire();
+  }
+  ASSERT_EQ(pool._slabs.size(), slabs);
+}
+
+TEST(Chunk, occupancy_masks_follow_writes) {
+  Chunk chunk;
+  chunk.set(0, 20, 5, Terrain::STONE);
+  chunk.set(15, 20, 5, Terrain::WATER);
+  chunk.set(7, 20, 5, Terrain::LEAF);
+  ASSERT_EQ(chunk.row(20, 5).opaque, (1 << 0) | (1 << 7));
+  ASSERT_EQ(chunk.row(20, 5).liquid, 1 << 15);
+  ASSERT_FALSE(chunk.isAir(15, 20, 5));
+
+  chunk.set(7, 20, 5, Terrain::AIR);
+  ASSERT_EQ(chunk.row(20, 5).opaque, 1 << 0);
+  ASSERT_TRUE(chunk.isAir(7, 20, 5));
+
+  // opaque faces exposed in +x for the whole row: opaque with a see-through right neighbour
+  Chunk::Row r = chunk.row(20, 5);
+  ASSERT_EQ(r.opaque & ~(r.opaque >> 1), 1 << 0);
+}
+
+TEST(World, snapshots_are_immutable_under_concurrent_edits) {
+  TestWorld t {"minecraft_snapshots", {12000, 100, 12000}, 2};
+  World& w = t.w;
+  glm::ivec2 center = t.center;
+
+  using Job = std::shared_ptr<const MeshJob>;
+  std::mutex mutex;
+  std::vector<Job> jobs;
+  std::vector<std::pair<Job, MeshResult>> results;
+  std::atomic<bool> done = false;
+
+  std::vector<std::thread> workers;
+  for (int t = 0; t < 3; ++t) {
+    workers.emplace_back([&]() {
+      while (true) {
+        Job job;
+        {
+          std::lock_guard<std::mutex> lock {mutex};
+          if (not jobs.empty()) {
+            job = jobs.back();
+            jobs.pop_back();
+          } else if (done) {
+            return;
+          }
+        }
+        if (job) {
+          MeshResult result = job->run();
+          std::lock_guard<std::mutex> lock {mutex};
+          results.emplace_back(job, std::move(result));
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+
+  auto same = [](const Mesh& a, const Mesh& b) {
+    return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(Instance)) == 0;
+  };
+
+  int installed = 0, stale = 0;
+  auto drain = [&]() {
+    std::vector<std::pair<Job, MeshResult>> ready;
+    {
+      std::lock_guard<std::mutex> lock {mutex};
+      ready.swap(results);
+    }
+    for (auto& [job, result] : ready) {
+      // the world moved on since the snapshot, the snapshot did not
+      MeshResult again = job->run();
+      EXPECT_TRUE(same(result.instances, again.instances));
+      EXPECT_TRUE(same(result.water_instances, again.water_instances));
+      w.install(result) ? ++installed : ++stale;
+    }
+  };
+
+  srand(30);
+  glm::ivec2 base = center * CHUNK_SIZE;
+  for (int round = 0; round < 100; ++round) {
+    {
+      std::lock_guard<std::mutex> lock {mutex};
+      jobs.emplace_back(std::make_shared<const MeshJob>(w.snapshot(center)));
+    }
+    // every other round edit the chunk and its +x neighbour for as long as the job is out,
+    // otherwise leave the world alone so the mesh comes back current and gets installed
+    while (installed + stale < round + 1) {
+      if (round % 2) {
+        int i = base.x + rand() % (2 * CHUNK_SIZE);
+        int j = 20 + rand() % 80;
+        int k = base.y + rand() % CHUNK_SIZE;
+        w.set(i, j, k, rand() % 2 ? Terrain::AIR : Terrain::LEAF);
+      }
+      drain();
+    }
+  }
+  done = true;
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+  drain();
+
+  ASSERT_EQ(installed + stale, 100);
+  ASSERT_EQ(installed, 50);
+  ASSERT_EQ(stale, 50);
+
+  MeshResult fresh = w.snapshot(center).run();
+  ASSERT_TRUE(w.install(fresh));
+}
+
+/// the access patterns of generation (columns top down), meshing (six neighbour probes)
+/// and collision (3x3x5 boxes) on raw sections in layout L. returns ms per pattern
+template <typename L>
+static std::array<double, 3> layoutBench() {
+  std::vector<Section::Blocks> sections(1024);
+  auto at = [](Section::Blocks& blocks, int i, int j, int k) -> u_char& { return blocks[L::index(i, j, k)]; };
+  using clock = std::chrono::steady_clock;
+  auto ms = [](clock::time_point a, clock::time_point b) { return std::chrono::duration<double, std::milli>(b - a).count(); };
+
+  auto t0 = clock::now();
+  for (size_t s = 0; s < sections.size(); ++s)
+  for (int i = 0; i < SECTION_SIZE; ++i)
+  for (int k = 0; k < SECTION_SIZE; ++k)
+  for (int j = SECTION_SIZE - 1; j >= 0; --j) {
+    at(sections[s], i, j, k) = (i * j + k + s) % 3 ? Terrain::STONE : Terrain::AIR;
+  }
+
+  auto t1 = clock::now();
+  long faces = 0;
+  for (Section::Blocks& blocks : sections)
+  for (int i = 1; i < SECTION_SIZE - 1; ++i)
+  for (int j = 1; j < SECTION_SIZE - 1; ++j)
+  for (int k = 1; k < SECTION_SIZE - 1; ++k) {
+    if (at(blocks, i, j, k) != Terrain::AIR) {
+      faces += (at(blocks, i + 1, j, k) == Terrain::AIR) + (at(blocks, i - 1, j, k) == Terrain::AIR)
+             + (at(blocks, i, j + 1, k) == Terrain::AIR) + (at(blocks, i, j - 1, k) == Terrain::AIR)
+             + (at(blocks, i, j, k + 1) == Terrain::AIR) + (at(blocks, i, j, k - 1) == Terrain::AIR);
+    }
+  }
+
+  auto t2 = clock::now();
+  long hits = 0;
+  uint32_t seed = 31;
+  for (int q = 0; q < 500000; ++q) {
+    seed = seed * 1664525 + 1013904223;
+    Section::Blocks& blocks = sections[(seed >> 8) % sections.size()];
+    int x = 1 + (seed >> 18) % 14, y = 2 + (seed >> 22) % 12, z = 1 + (seed >> 26) % 14;
+    for (int i = -1; i <= 1; ++i)
+    for (int k = -1; k <= 1; ++k)
+    for (int j = -2; j <= 1; ++j) {
+      hits += at(blocks, x + i, y + j, z + k) != Terrain::AIR;
+    }
+  }
+  auto t3 = clock::now();
+
+  EXPECT_GT(faces + hits, 0);
+  return {ms(t0, t1), ms(t1, t2), ms(t2, t3)};
+}
+
+template <typename L>
+static bool isPermutation() {
+  std::array<bool, Section::VOLUME> seen {};
+  for (int i = 0; i < SECTION_SIZE; ++i)
+  for (int j = 0; j < SECTION_SIZE; ++j)
+  for (int k = 0; k < SECTION_SIZE; ++k) {
+    int index = L::index(i, j, k);
+    if (index < 0 || index >= Section::VOLUME || seen[index]) {
+      return false;
+    }
+    seen[index] = true;
+  }
+  return true;
+}
+
+TEST(Layout, orders_are_permutations) {
+  ASSERT_TRUE(isPermutation<Layout::Linear>());
+  ASSERT_TRUE(isPermutation<Layout::YMajor>());
+  ASSERT_TRUE(isPermutation<Layout::Morton>());
+}
+
+// a benchmark rather than a test: timings only, so it does not run with the suite.
+// run it with --gtest_also_run_disabled_tests --gtest_filter=Layout.DISABLED_bench
+TEST(Layout, DISABLED_bench) {
+  auto print = [](const char* name, std::array<double, 3> t) {
+    std::cout << name << ": generate " << t[0] << " ms, mesh " << t[1] << " ms, collide " << t[2] << " ms" << std::endl;
+  };
+  for (int round = 0; round < 2; ++round) {
+    print("Linear", layoutBench<Layout::Linear>());
+    print("YMajor", layoutBench<Layout::YMajor>());
+    print("Morton", layoutBench<Layout::Morton>());
+  }
+}
+
+TEST(World, journal_batches_edits_per_publish) {
+  TestWorld t {"minecraft_journal", {16000, 100, 16000}, 2};
+  World& w = t.w;
+  glm::ivec2 center = t.center;
+  // the edits below happen inside a block of stone, where they change no light
+  glm::ivec3 base {center.x * CHUNK_SIZE, 105, center.y * CHUNK_SIZE};
+  w.fill({glm::ivec3(base.x - 3, 100, base.z), glm::ivec3(base.x + 9, 111, base.z + 10)}, Terrain::STONE);
+  for (int i = -1; i <= 1; ++i)
+  for (int k = -1; k <= 1; ++k) {
+    w.buildChunk(center + glm::ivec2(i, k));
+  }
+
+  // nothing is recorded before anyone listens
+  w.set(base.x + 5, base.y, base.z + 5, Terrain::LEAF);
+  ASSERT_TRUE(w._journal.empty());
+
+  std::vector<std::vector<BlockChange>> batches;
+  w.subscribe([&](const Changes& changes) { batches.emplace_back(changes.blocks); });
+  w.subscribe([&](const Changes& changes) {
+    for (const BlockChange& change : changes.blocks) {
+      w.invalidate(change.position);
+    }
+  });
+
+  uint64_t east_edge = w.chunk(center)->edgeVersion(0);
+  w.set(base.x + 5, base.y, base.z + 5, Terrain::AIR);
+  w.set(base.x, base.y, base.z + 5, Terrain::AIR);       // on the -x face of the chunk
+  w.set(base.x, base.y, base.z + 5, Terrain::AIR);       // no change, no event
+  w.publish();
+  w.publish();                                           // empty batches are not delivered
+
+  ASSERT_EQ(batches.size(), 1u);
+  ASSERT_EQ(batches[0].size(), 2u);
+  ASSERT_EQ(batches[0][0].position, glm::ivec3(base.x + 5, base.y, base.z + 5));
+  ASSERT_EQ(batches[0][0].old_block, Terrain::LEAF);
+  ASSERT_EQ(batches[0][0].new_block, Terrain::AIR);
+  ASSERT_EQ(batches[0][1].new_block, Terrain::AIR);
+  ASSERT_LT(batches[0][0].version, batches[0][1].version);
+  ASSERT_EQ(batches[0][1].version, w.chunk(center)->_version);
+  ASSERT_TRUE(w._journal.empty());
+
+  // only the section with the edits is meshed again. of the neighbours, only the one whose face an edit
+  // is on sees a new edge, which differs in that section alone
+  uint32_t section = 1u << (base.y / SECTION_SIZE);
+  ASSERT_EQ(w.chunk(center)->_dirty, section);
+  ASSERT_EQ(w.chunk(center + glm::ivec2(-1, 0))->_dirty, 0u);
+  ASSERT_EQ(w.chunk(center)->edgeVersion(0), east_edge);
+  const Chunk* west = w.chunk(center + glm::ivec2(-1, 0));
+  ASSERT_EQ(w.chunk(center)->edge(2)->differ(*west->_meshed_against[0]), section);
+  std::shared_ptr<const Edge> meshed_against = w.chunk(center + glm::ivec2(1, 0))->_meshed_against[2];
+
+  // in one go, and the spliced meshes are what meshing the whole chunks gives
+  w.remesh();
+  ASSERT_EQ(w.chunk(center + glm::ivec2(1, 0))->_meshed_against[2], meshed_against);
+  for (glm::ivec2 chunk_index : {center, center + glm::ivec2(-1, 0)}) {
+    const Chunk* chunk = w.chunk(chunk_index);
+    ASSERT_EQ(chunk->_state, Chunk::State::Built);
+    ASSERT_EQ(chunk->_dirty, 0u);
+    MeshResult whole = w.snapshot(chunk_index).run();
+    ASSERT_EQ(chunk->_instances.size(), whole.instances.size());
+    ASSERT_EQ(std::memcmp(chunk->_instances.data(), whole.instances.data(), whole.instances.size() * sizeof(Instance)), 0);
+  }
+}
+
+TEST(World, bulk_edits) {
+  TestWorld t("minecraft_bulk", {24000, 100, 24000});
+  World& w = t.w;
+  glm::ivec3 base {24000 - 128, 0, 24000 - 128};
+  for (int x = 0; x < 256 / CHUNK_SIZE; ++x)
+  for (int z = 0; z < 256 / CHUNK_SIZE; ++z) {
+    w.create(World::toChunk(base) + glm::ivec2(x, z));
+  }
+  Changes published;
+  w.subscribe([&](const Changes& changes) { published = changes; });
+
+  // 256^3, clipped to the world's height
+  auto ms = [](auto f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  };
+  Box cube {base, base + glm::ivec3(256)};
+  double fill_ms = ms([&] { w.fill(cube, Terrain::LEAF); });
+  Box ragged {base + glm::ivec3(3, 5, 7), base + glm::ivec3(250, 121, 249)};
+  double ragged_ms = ms([&] { w.fill(ragged, Terrain::DIRT); });
+  double replace_ms = ms([&] { w.replace(cube, Terrain::DIRT, Terrain::STONE); });
+  ASSERT_LT(fill_ms + ragged_ms + replace_ms, 1000);
+
+  ASSERT_EQ(w(base.x, 0, base.z), Terrain::LEAF);
+  ASSERT_EQ(w(base.x + 3, 5, base.z + 7), Terrain::STONE);
+  ASSERT_EQ(w(base.x + 249, 120, base.z + 248), Terrain::STONE);
+  ASSERT_EQ(w(base.x + 250, 120, base.z + 248), Terrain::LEAF);
+  ASSERT_EQ(w(base.x + 3, 121, base.z + 7), Terrain::LEAF);
+  ASSERT_FALSE(w.isAir(base.x + 100, 50, base.z + 100));
+
+  // three edits, three regions, no per-block events
+  w.publish();
+  ASSERT_TRUE(published.blocks.empty());
+  ASSERT_EQ(published.regions.size(), 3u);
+
+  // a sphere carved out matches the brute force count
+  glm::ivec3 center = base + glm::ivec3(40, 60, 40);
+  w.sphere(center, 9, Terrain::AIR);
+  int carved = 0, expected = 0;
+  for (int i = -10; i <= 10; ++i)
+  for (int j = -10; j <= 10; ++j)
+  for (int k = -10; k <= 10; ++k) {
+    expected += i * i + j * j + k * k <= 81;
+    carved += w.isAir(center.x + i, center.y + j, center.z + k);
+  }
+  ASSERT_EQ(carved, expected);
+
+  // copy across a chunk border and paste it back somewhere else
+  Box source {center - glm::ivec3(10), center + glm::ivec3(11)};
+  Clipboard clipboard = w.copy(source);
+  glm::ivec3 target = base + glm::ivec3(150, 30, 170);
+  w.paste(clipboard, target);
+  for (int i = 0; i < 21; ++i)
+  for (int j = 0; j < 21; ++j)
+  for (int k = 0; k < 21; ++k) {
+    ASSERT_EQ(w(target.x + i, target.y + j, target.z + k), w(source.min.x + i, source.min.y + j, source.min.z + k));
+  }
+
+  // edits that change nothing leave the chunks and the journal alone
+  Chunk* chunk = w.chunk(World::toChunk(target));
+  uint64_t version = chunk->_version;
+  w.publish();
+  published = {};
+  w.paste(clipboard, target);
+  w.fill({base, base + glm::ivec3(16, 1, 16)}, Terrain::LEAF);
+  w.replace(cube, Terrain::WATER, Terrain::AIR);
+  w.sphere(center, 9, Terrain::AIR);
+  ASSERT_EQ(chunk->_version, version);
+  w.publish();
+  ASSERT_TRUE(published.regions.empty());
+}
+
+TEST(Terrain, registry_drives_masks) {
+  ASSERT_EQ(Terrain::mask(Terrain::LIQUID), 1u << Terrain::WATER | 0x7Fu << Terrain::FLOW_1);
+  ASSERT_EQ(Terrain::str(Terrain::LEAF), "Leaf");
+  ASSERT_EQ(Terrain::PROPERTIES[200], 0);
+
+  for (int b = 0; b < Terrain::BLOCK_COUNT; ++b) {
+    Chunk chunk;
+    chunk.set(4, 9, 4, b);
+    ASSERT_EQ((chunk.row(9, 4).opaque >> 4) & 1, Terrain::has(b, Terrain::OPAQUE)) << Terrain::str(b);
+    ASSERT_EQ((chunk.row(9, 4).liquid >> 4) & 1, Terrain::has(b, Terrain::LIQUID)) << Terrain::str(b);
+  }
+
+  std::vector<glm::vec4> base, off;
+  Terrain::setColors(base, off);
+  ASSERT_EQ(base.size(), size_t(Terrain::BLOCK_COUNT));
+  ASSERT_EQ(base[Terrain::GRASS], glm::vec4(0.2, 0.8, 0, 1));
+}
+
+TEST(FarField, explored_chunks_stay_small_and_match_their_blocks) {
+  constexpr int radius = 12;
+  constexpr int side = 2 * radius + 1;
+  TestWorld t("minecraft_far_field", {16000, 100, 16000}, radius);
+  World& w = t.w;
+  glm::ivec2 first = t.center - glm::ivec2(radius);
+  // nothing is meshed here, so the far field is filled by hand
+  for (int x = 0; x < side; ++x)
+  for (int z = 0; z < side; ++z) {
+    w._far_field.update(first + glm::ivec2(x, z), *w.chunk(first + glm::ivec2(x, z)));
+  }
+  ASSERT_LT(w._far_field.bytesPerChunk(), w.bytes() / w._chunks.size() / 10);
+
+  // level 0 is the majority rule over every cell, level 1 the same rule over eight cells
+  constexpr int S = FAR_FIELD_SCALE;
+  glm::ivec2 probe = first + glm::ivec2(side / 2);
+  const Chunk& chunk = *w.chunk(probe);
+  std::vector<u_char> cells;
+  w._far_field.extract(probe, 0, cells);
+  ASSERT_EQ(cells.size(), size_t(FarField::CHUNK_CELLS * FarField::HEIGHT_CELLS * FarField::CHUNK_CELLS));
+  for (int x = 0; x < FarField::CHUNK_CELLS; ++x)
+  for (int y = 0; y < FarField::HEIGHT_CELLS; ++y)
+  for (int z = 0; z < FarField::CHUNK_CELLS; ++z) {
+    std::array<int, 256> counts {};
+    for (int i = 0; i < S; ++i)
+    for (int j = 0; j < S; ++j)
+    for (int k = 0; k < S; ++k) {
+      counts[chunk.get(x * S + i, y * S + j, z * S + k)]++;
+    }
+    u_char expected = Terrain::AIR;
+    if (counts[Terrain::AIR] * 2 <= S * S * S) {
+      counts[Terrain::AIR] = 0;
+      expected = std::max_element(counts.begin(), counts.end()) - counts.begin();
+    }
+    ASSERT_EQ(cells[(x * FarField::HEIGHT_CELLS + y) * FarField::CHUNK_CELLS + z], expected) << x << " " << y << " " << z;
+  }
+
+  // an edit shows up once the chunk is updated, and collecting the old copy changes nothing
+  glm::ivec3 origin = World::chunkBox(probe).min;
+  constexpr int top = CHUNK_HEIGHT - S;
+  w.fill({origin + glm::ivec3(0, top, 0), origin + glm::ivec3(S, top + S, S)}, Terrain::LEAF);
+  ASSERT_EQ(w._far_field.sample(probe, {0, top / S, 0}, 0), Terrain::AIR);
+  w._far_field.update(probe, chunk);
+  ASSERT_EQ(w._far_field.sample(probe, {0, top / S, 0}, 0), Terrain::LEAF);
+
+  std::vector<std::vector<u_char>> before(side);
+  for (int x = 0; x < side; ++x) {
+    w._far_field.extract(first + glm::ivec2(x, x), 1, before[x]);
+  }
+  size_t nodes = w._far_field._nodes.size();
+  w._far_field.collect();
+  ASSERT_LE(w._far_field._nodes.size(), nodes);
+  for (int x = 0; x < side; ++x) {
+    std::vector<u_char> after;
+    w._far_field.extract(first + glm::ivec2(x, x), 1, after);
+    ASSERT_EQ(after, before[x]);
+  }
+
+  // eviction keeps what was explored
+  w._memory_budget = 0;
+  t.p.setPos(glm::vec3(16000 + 16 * 3 * RETENTION_DISTANCE, 100, 16000));
+  w.handleTick(t.p);
+  w.evict();
+  ASSERT_FALSE(w.hasChunk(probe));
+  ASSERT_TRUE(w._far_field.explored(probe));
+  ASSERT_EQ(w._far_field.sample(probe, {0, top / S, 0}, 0), Terrain::LEAF);
+}
+
+TEST(World, summary_queries_match_scans) {
+  // regions are all SUMMARY_REGION_CHUNKS wide, across 0 too
+  constexpr int R = SUMMARY_REGION_CHUNKS;
+  ASSERT_EQ(World::toRegion({0, R - 1}), glm::ivec2(0, 0));
+  ASSERT_EQ(World::toRegion({-1, -R}), glm::ivec2(-1, -1));
+  ASSERT_EQ(World::toRegion({-R - 1, R}), glm::ivec2(-2, 1));
+
+  TestWorld t("minecraft_summary", {28000, 100, 28000});
+  Player& p = t.p;
+  World& w = t.w;
+  TerrainGen::spawn(w, p);
+
+  auto ms = [](auto f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  };
+  auto scan = [&w](Box box, auto f) {
+    for (int i = box.min.x; i < box.max.x; ++i)
+    for (int j = box.min.y; j < box.max.y; ++j)
+    for (int k = box.min.z; k < box.max.z; ++k) {
+      if (j >= 0 && j < CHUNK_HEIGHT && w.hasChunk(World::toChunk({i, j, k})) && f(glm::ivec3(i, j, k), w(i, j, k))) {
+        return;
+      }
+    }
+  };
+
+  glm::ivec3 center = p.blockPosition();
+  Box box {center - glm::ivec3(100, center.y, 100), center + glm::ivec3(100, CHUNK_HEIGHT - center.y, 100)};
+
+  size_t leaves = 0, naive_leaves = 0;
+  bool sky_stone = true, naive_sky_stone = false;
+  Box sky {glm::ivec3(box.min.x, CHUNK_HEIGHT - 8, box.min.z), box.max};
+  double summary_ms = ms([&] {
+    leaves = w.countInBox(box, Terrain::LEAF);
+    sky_stone = w.anyOfType(sky, Terrain::STONE);
+  });
+  double naive_ms = ms([&] {
+    scan(box, [&](glm::ivec3, u_char b) { naive_leaves += b == Terrain::LEAF; return false; });
+    scan(sky, [&](glm::ivec3, u_char b) { return naive_sky_stone = b == Terrain::STONE; });
+  });
+  ASSERT_EQ(leaves, naive_leaves);
+  ASSERT_EQ(sky_stone, naive_sky_stone);
+  ASSERT_TRUE(w.anyOfType(box, Terrain::STONE));
+  ASSERT_EQ(w.countInBox(World::chunkBox(World::toChunk(center)), Terrain::AIR)
+            + w.countInBox(World::chunkBox(World::toChunk(center)), Terrain::STONE)
+            + w.countInBox(World::chunkBox(World::toChunk(center)), Terrain::GRASS)
+            + w.countInBox(World::chunkBox(World::toChunk(center)), Terrain::DIRT)
+            + w.countInBox(World::chunkBox(World::toChunk(center)), Terrain::WATER)
+            + w.countInBox(World::chunkBox(World::toChunk(center)), Terrain::LEAF),
+            size_t(CHUNK_SIZE * CHUNK_HEIGHT * CHUNK_SIZE));
+
+  // nearest water, then again after a write moves the answer
+  constexpr int radius = 64;
+  glm::ivec3 nearest, naive_nearest;
+  bool any = false;
+  int naive_best = radius * radius + 1;
+  any = w.nearestOfType(center, Terrain::WATER, radius, nearest);
+  scan({center - glm::ivec3(radius), center + glm::ivec3(radius + 1)}, [&](glm::ivec3 q, u_char b) {
+    glm::ivec3 d = q - center;
+    int d2 = d.x * d.x + d.y * d.y + d.z * d.z;
+    if (b == Terrain::WATER && d2 < naive_best) {
+      naive_best = d2;
+      naive_nearest = q;
+    }
+    return false;
+  });
+  ASSERT_EQ(any, naive_best <= radius * radius);
+  if (any) {
+    glm::ivec3 d = nearest - center;
+    ASSERT_EQ(d.x * d.x + d.y * d.y + d.z * d.z, naive_best);
+  }
+  glm::ivec3 puddle = center + glm::ivec3(2, 3, 1);
+  w.set(puddle.x, puddle.y, puddle.z, Terrain::WATER);
+  ASSERT_TRUE(w.nearestOfType(center, Terrain::WATER, radius, nearest));
+  ASSERT_EQ(nearest, puddle);
+  w.set(puddle.x, puddle.y, puddle.z, Terrain::AIR);
+  ASSERT_FALSE(w.anyOfType({puddle, puddle + glm::ivec3(1)}, Terrain::WATER));
+
+  ASSERT_LT(summary_ms, naive_ms);
+}
+
+TEST(Light, incremental_updates_match_relighting_from_scratch) {
+  // chunks on the negative side are as wide as the rest, and a block's local coordinates are inside its chunk
+  ASSERT_EQ(World::toChunk({-1, 0, -16}), glm::ivec2(-1, -1));
+  ASSERT_EQ(World::toChunk({-17, 0, 16}), glm::ivec2(-2, 1));
+  ASSERT_EQ(World::toLocal({-1, 7, -17}), glm::ivec3(CHUNK_SIZE - 1, 7, CHUNK_SIZE - 1));
+  ASSERT_EQ(World::toLocal({-20, 7, 20}), glm::ivec3(12, 7, 4));
+
+  // on both sides of the origin: the edits there cross chunk borders at negative coordinates
+  for (glm::vec3 at : {glm::vec3(32000, 100, 32000), glm::vec3(-32000, 100, -32000)}) {
+    TestWorld t("minecraft_light", at, 2);
+    World& w = t.w;
+    glm::ivec2 center = t.center;
+    std::vector<glm::ivec2> all;
+    for (int i = -2; i <= 2; ++i)
+    for (int k = -2; k <= 2; ++k) {
+      all.emplace_back(center + glm::ivec2(i, k));
+    }
+    auto light = [&w](glm::ivec3 q) { return w.chunk(World::toChunk(q))->light(World::toLocal(q).x, q.y, World::toLocal(q).z); };
+    auto lights = [&w, &all] {
+      std::vector<u_char> values;
+      for (glm::ivec2 chunk_index : all)
+      for (int i = 0; i < CHUNK_SIZE; ++i)
+      for (int j = 0; j < CHUNK_HEIGHT; ++j)
+      for (int k = 0; k < CHUNK_SIZE; ++k) {
+        values.push_back(w.chunk(chunk_index)->light(i, j, k));
+      }
+      return values;
+    };
+
+    // generation lights each chunk once its caves and trees are in, and joins it to its neighbours
+    std::vector<u_char> generated = lights();
+    Light::relight(w, all);
+    ASSERT_TRUE(generated == lights());
+
+    // a lamp in a sealed stone room is the only light there: its own level on it, one less every block out
+    glm::ivec3 room = glm::ivec3(center.x * CHUNK_SIZE + 8, 20, center.y * CHUNK_SIZE + 8);
+    w.fill({room - glm::ivec3(4), room + glm::ivec3(5)}, Terrain::STONE);
+    w.fill({room - glm::ivec3(3), room + glm::ivec3(4)}, Terrain::AIR);
+    ASSERT_EQ(light(room), 0);
+    w.set(room.x, room.y, room.z, Terrain::LAMP);
+    ASSERT_EQ(Light::block(light(room)), Terrain::EMISSION[Terrain::LAMP]);
+    ASSERT_EQ(Light::block(light(room + glm::ivec3(1, 0, 0))), Terrain::EMISSION[Terrain::LAMP] - 1);
+    ASSERT_EQ(Light::block(light(room + glm::ivec3(2, 1, 0))), Terrain::EMISSION[Terrain::LAMP] - 3);
+    ASSERT_EQ(Light::sky(light(room + glm::ivec3(2, 1, 0))), 0);
+    w.set(room.x, room.y, room.z, Terrain::AIR);
+    ASSERT_EQ(light(room + glm::ivec3(2, 1, 0)), 0);
+
+    // a roof high up shades what is under it and leaves the open sky around it alone
+    glm::ivec3 roof {center.x * CHUNK_SIZE + 3, CHUNK_HEIGHT - 2, center.y * CHUNK_SIZE + 3};
+    w.fill({roof, roof + glm::ivec3(5, 1, 5)}, Terrain::LEAF);
+    ASSERT_EQ(Light::sky(light(roof + glm::ivec3(2, -1, 2))), Light::MAX - 3);
+    ASSERT_EQ(Light::sky(light(roof + glm::ivec3(-1, -1, 2))), Light::MAX);
+
+    // block by block edits leave the same light as lighting every chunk again
+    srand(38);
+    glm::ivec3 origin {center.x * CHUNK_SIZE - 20, 40, center.y * CHUNK_SIZE - 20};
+    const u_char palette[] = {Terrain::AIR, Terrain::AIR, Terrain::STONE, Terrain::LEAF, Terrain::LAMP, Terrain::WATER};
+    for (int n = 0; n < 3000; ++n) {
+      glm::ivec3 q = origin + glm::ivec3(rand() % 56, rand() % 80, rand() % 56);
+      w.set(q.x, q.y, q.z, palette[rand() % 6]);
+    }
+    std::vector<u_char> incremental = lights();
+    Light::relight(w, all);
+    ASSERT_TRUE(incremental == lights());
+
+    // faces carry the light in front of them
+    w.buildChunk(center);
+    const Mesh& mesh = w.chunk(center)->_instances;
+    ASSERT_TRUE(std::any_of(mesh.begin(), mesh.end(), [](const Instance& f) { return Light::sky(f.light()) == Light::MAX; }));
+    ASSERT_TRUE(std::any_of(mesh.begin(), mesh.end(), [](const Instance& f) { return Light::block(f.light()) > 0; }));
+  }
+}
+
+TEST(Water, dam_break_settles_within_the_tick_budget) {
+  TestWorld t("minecraft_water", {36000, 100, 36000});
+  World& w = t.w;
+  glm::ivec2 first = t.center;
+  for (int i = 0; i < 5; ++i)
+  for (int k = 0; k < 4; ++k) {
+    w.create(first + glm::ivec2(i, k));
+  }
+  for (int i = 0; i < 5; ++i)
+  for (int k = 0; k < 4; ++k) {
+    TerrainGen::chunk(w, first + glm::ivec2(i, k));
+  }
+  std::vector<BlockChange> published;
+  w.subscribe([&](const Changes& changes) {
+    published.insert(published.end(), changes.blocks.begin(), changes.blocks.end());
+  });
+
+  // a stone floor, and on it a walled reservoir of 50 x 40 x 50 = 100k source blocks
+  glm::ivec3 o {first.x * CHUNK_SIZE, 0, first.y * CHUNK_SIZE};
+  w.fill({o, o + glm::ivec3(80, CHUNK_HEIGHT, 64)}, Terrain::AIR);
+  w.fill({o, o + glm::ivec3(80, 10, 64)}, Terrain::STONE);
+  w.fill({o + glm::ivec3(0, 10, 0), o + glm::ivec3(52, 52, 52)}, Terrain::STONE);
+  while (not w._water.settled()) {
+    w._water.tick(w);
+  }
+  // a fill wakes its border and the shell around it, none of the 76k cells inside
+  w.fill({o + glm::ivec3(1, 10, 1), o + glm::ivec3(51, 50, 51)}, Terrain::WATER);
+  ASSERT_LE(w._water._active.size(), size_t(52 * 42 * 52 - 48 * 38 * 48));
+  ASSERT_EQ(w.countInBox({o, o + glm::ivec3(80, CHUNK_HEIGHT, 64)}, Terrain::WATER), 100000u);
+
+  size_t most_cells = 0;
+  auto settle = [&] {
+    int ticks = 0;
+    while (not w._water.settled()) {
+      w._water.tick(w);
+      most_cells = std::max(most_cells, w._water._last_cells);
+      w.publish();
+      ASSERT_LT(++ticks, 1000);
+    }
+  };
+  // still water stays still
+  settle();
+  ASSERT_TRUE(published.empty());
+
+  // take out the +x wall: water falls out of the gap and runs SOURCE_LEVEL - 1 blocks along the floor
+  w.fill({o + glm::ivec3(51, 10, 1), o + glm::ivec3(52, 50, 51)}, Terrain::AIR);
+  settle();
+  ASSERT_LE(most_cells, size_t(WATER_TICK_BUDGET));
+  ASSERT_FALSE(published.empty());
+  ASSERT_TRUE(std::all_of(published.begin(), published.end(), [](const BlockChange& c) { return Terrain::LEVEL[c.new_block] < Terrain::SOURCE_LEVEL; }));
+  ASSERT_EQ(w(o.x + 51, 30, o.z + 25), Terrain::flowing(7));
+  ASSERT_EQ(w(o.x + 51, 10, o.z + 25), Terrain::flowing(7));
+  ASSERT_EQ(w(o.x + 57, 10, o.z + 25), Terrain::flowing(1));
+  ASSERT_EQ(w(o.x + 58, 10, o.z + 25), Terrain::AIR);
+  ASSERT_EQ(w(o.x + 52, 11, o.z + 25), Terrain::AIR);
+  ASSERT_EQ(w.countInBox({o, o + glm::ivec3(80, CHUNK_HEIGHT, 64)}, Terrain::WATER), 100000u);
+
+  // settled means no cell anywhere would change
+  for (int i = 0; i < 80; ++i)
+  for (int j = 0; j < 60; ++j)
+  for (int k = 0; k < 64; ++k) {
+    glm::ivec3 q = o + glm::ivec3(i, j, k);
+    ASSERT_EQ(Water::next(w, q), w(q.x, q.y, q.z)) << i << " " << j << " " << k;
+  }
+
+  // close the dam again and what ran out dries up
+  w.fill({o + glm::ivec3(51, 10, 1), o + glm::ivec3(52, 50, 51)}, Terrain::STONE);
+  settle();
+  for (int level = 1; level < Terrain::SOURCE_LEVEL; ++level) {
+    ASSERT_EQ(w.countInBox({o + glm::ivec3(52, 0, 0), o + glm::ivec3(80, CHUNK_HEIGHT, 64)}, Terrain::flowing(level)), 0u);
+  }
+
+  // on the negative side of the origin, a source on the border between two chunks runs
+  // SOURCE_LEVEL - 1 blocks into both of them
+  TestWorld negative {"minecraft_water_negative", {-36000, 100, -36000}, 1};
+  World& v = negative.w;
+  glm::ivec3 n {negative.center.x * CHUNK_SIZE, 0, negative.center.y * CHUNK_SIZE + 8};
+  Box pool {n - glm::ivec3(16, 0, 24), n + glm::ivec3(32, CHUNK_HEIGHT, 24)};
+  v.fill(pool, Terrain::AIR);
+  v.fill({pool.min, glm::ivec3(pool.max.x, 10, pool.max.z)}, Terrain::STONE);
+  v.set(n.x, 10, n.z, Terrain::WATER);
+  for (int ticks = 0; not v._water.settled(); ++ticks) {
+    v._water.tick(v);
+    ASSERT_LT(ticks, 1000);
+  }
+  ASSERT_EQ(v(n.x - 1, 10, n.z), Terrain::flowing(7));
+  ASSERT_EQ(v(n.x - 7, 10, n.z), Terrain::flowing(1));
+  ASSERT_EQ(v(n.x - 8, 10, n.z), Terrain::AIR);
+  ASSERT_EQ(v(n.x + 7, 10, n.z), Terrain::flowing(1));
+  ASSERT_EQ(v(n.x, 10, n.z - 7), Terrain::flowing(1));
+  for (int i = pool.min.x + 1; i < pool.max.x - 1; ++i)
+  for (int k = pool.min.z + 1; k < pool.max.z - 1; ++k) {
+    ASSERT_EQ(Water::next(v, {i, 10, k}), v(i, 10, k)) << i << " " << k;
+  }
+}
+
+TEST(Scheduler, wheel_runs_every_update_on_its_tick) {
+  Scheduler s;
+  srand(40);
+  struct Expected { Scheduler::Handle handle; uint64_t due; bool cancelled; };
+  std::vector<Expected> expected;
+  for (int n = 0; n < 20000; ++n) {
+    // mostly soon, some across every level boundary the test reaches
+    uint32_t delay = 1 + (n % 3 == 0 ? rand() % (1 << 20) : rand() % 300);
+    Scheduler::Handle handle = s.schedule({100 + n, 0, 100}, BlockUpdate::LEAF_DECAY, delay);
+    expected.push_back({handle, delay, false});
+  }
+  for (size_t n = 0; n < expected.size(); n += 7) {
+    ASSERT_TRUE(s.cancel(expected[n].handle));
+    expected[n].cancelled = true;
+  }
+  ASSERT_FALSE(s.cancel(expected[0].handle));
+
+  std::vector<BlockUpdate> due;
+  size_t ran = 0;
+  while (s._pending > 0) {
+    due.clear();
+    s.advance(due);
+    for (const BlockUpdate& update : due) {
+      const Expected& e = expected[update.position.x - 100];
+      ASSERT_FALSE(e.cancelled);
+      ASSERT_EQ(e.due, s._now);
+      ++ran;
+    }
+  }
+  ASSERT_EQ(ran, expected.size() - (expected.size() + 6) / 7);
+  ASSERT_TRUE(s._chunks.empty());
+  ASSERT_FALSE(s.cancel(expected[1].handle));
+
+  // a chunk that goes away takes its updates along, and they keep the ticks they had left
+  s.schedule({40, 70, 40}, BlockUpdate::LEAF_DECAY, 300);
+  s.schedule({90, 70, 40}, BlockUpdate::LEAF_DECAY, 300);
+  for (int t = 0; t < 100; ++t) {
+    s.advance(due);
+  }
+  std::vector<Scheduler::Suspended> suspended = s.suspend({2, 2});
+  ASSERT_EQ(suspended.size(), 1u);
+  ASSERT_EQ(suspended[0].delay, 200u);
+  due.clear();
+  for (int t = 0; t < 1000; ++t) {
+    s.advance(due);
+  }
+  ASSERT_EQ(due.size(), 1u);
+  ASSERT_EQ(due[0].position, glm::ivec3(90, 70, 40));
+  s.resume({2, 2}, suspended);
+  due.clear();
+  for (int t = 0; t < 200; ++t) {
+    s.advance(due);
+  }
+  ASSERT_EQ(due.size(), 1u);
+  ASSERT_EQ(due[0].position, glm::ivec3(40, 70, 40));
+}
+
+TEST(Scheduler, leaves_without_a_trunk_decay_even_across_a_save) {
+  TestWorld t("minecraft_updates", {40000, 100, 40000});
+  World& w = t.w;
+  // far enough from the player for random ticks to leave it alone, and to be evicted
+  glm::ivec2 center = t.center + glm::ivec2(3 * RETENTION_DISTANCE, 0);
+  for (int i = -1; i <= 1; ++i)
+  for (int k = -1; k <= 1; ++k) {
+    w.create(center + glm::ivec2(i, k));
+  }
+  for (int i = -1; i <= 1; ++i)
+  for (int k = -1; k <= 1; ++k) {
+    TerrainGen::chunk(w, center + glm::ivec2(i, k));
+  }
+
+  // a trunk four high with a 5 x 5 layer of leaves on top
+  glm::ivec3 base {center.x * CHUNK_SIZE + 8, 100, center.y * CHUNK_SIZE + 8};
+  auto plant = [&] {
+    w.fill({base - glm::ivec3(4, 0, 4), base + glm::ivec3(5, 10, 5)}, Terrain::AIR);
+    w.fill({base, base + glm::ivec3(1, 4, 1)}, Terrain::DIRT);
+    w.fill({base + glm::ivec3(-2, 4, -2), base + glm::ivec3(3, 5, 3)}, Terrain::LEAF);
+  };
+  Box canopy {base + glm::ivec3(-2, 4, -2), base + glm::ivec3(3, 5, 3)};
+  auto run = [&](int ticks) {
+    for (int t = 0; t < ticks; ++t) {
+      w._updates.tick(w);
+    }
+  };
+
+  // leaves that can still reach the trunk stay
+  plant();
+  w.set(base.x + 2, base.y + 4, base.z + 2, Terrain::AIR);
+  ASSERT_GT(w._updates._pending, 0u);
+  run(200);
+  ASSERT_EQ(w._updates._pending, 0u);
+  ASSERT_EQ(w.countInBox(canopy, Terrain::LEAF), 24u);
+
+  // take the trunk away and they fall one after another
+  for (int j = 3; j >= 0; --j) {
+    w.set(base.x, base.y + j, base.z, Terrain::AIR);
+  }
+  run(400);
+  ASSERT_EQ(w.countInBox(canopy, Terrain::LEAF), 0u);
+
+  // again, but the chunk goes to disk before any of them fell
+  plant();
+  for (int j = 3; j >= 0; --j) {
+    w.set(base.x, base.y + j, base.z, Terrain::AIR);
+  }
+  run(5);
+  w._memory_budget = 0;
+  w.evict();
+  ASSERT_FALSE(w.hasChunk(center));
+  ASSERT_EQ(w._updates._pending, 0u);
+  run(1000);
+
+  w.create(center);
+  ASSERT_EQ(w.countInBox(canopy, Terrain::LEAF), 25u);
+  ASSERT_GT(w._updates._pending, 0u);
+  run(400);
+  ASSERT_EQ(w.countInBox(canopy, Terrain::LEAF), 0u);
+
+  // a bulk edit that takes the trunk away checks the leaves around its box the same way
+  plant();
+  run(200);
+  w.fill({base, base + glm::ivec3(1, 4, 1)}, Terrain::AIR);
+  ASSERT_GT(w._updates._pending, 0u);
+  run(400);
+  ASSERT_EQ(w.countInBox(canopy, Terrain::LEAF), 0u);
+
+  // a file that claims more pending updates than a chunk has blocks is damaged, not a reason to allocate them
+  std::string file = ChunkStore::directory + "/" + std::to_string(center.x) + "." + std::to_string(center.y) + ".chunk";
+  ASSERT_TRUE(ChunkStore::save(*w.chunk(center), center, {}));
+  {
+    std::fstream damaged {file, std::ios::binary | std::ios::in | std::ios::out};
+    damaged.seekp(-int(sizeof(uint32_t)), std::ios::end);
+    uint32_t count = ~0u;
+    damaged.write(reinterpret_cast<const char*>(&count), sizeof(count));
+  }
+  Chunk chunk;
+  std::vector<Scheduler::Suspended> updates;
+  ASSERT_FALSE(ChunkStore::load(chunk, center, updates));
+  ASSERT_TRUE(updates.empty());
+  ASSERT_EQ(chunk._state, Chunk::State::Exists);
+
+  // at negative coordinates: a leaf held up by a trunk in the chunk across the border stays, one on its
+  // own falls, and dirt next to grass in the chunk across the border grows over
+  TestWorld negative {"minecraft_updates_negative", {-40000, 100, -40000}, 1};
+  World& v = negative.w;
+  glm::ivec3 n {negative.center.x * CHUNK_SIZE, 100, negative.center.y * CHUNK_SIZE + 8};
+  v.fill({n - glm::ivec3(4, 10, 4), n + glm::ivec3(5, 10, 5)}, Terrain::AIR);
+  v.set(n.x - 1, n.y, n.z, Terrain::DIRT);
+  v.set(n.x, n.y, n.z, Terrain::LEAF);
+  v.set(n.x + 3, n.y, n.z, Terrain::LEAF);
+  v._updates.schedule(n, BlockUpdate::LEAF_DECAY, 1);
+  v._updates.schedule(n + glm::ivec3(3, 0, 0), BlockUpdate::LEAF_DECAY, 1);
+  v._updates.tick(v);
+  ASSERT_EQ(v(n.x, n.y, n.z), Terrain::LEAF);
+  ASSERT_EQ(v(n.x + 3, n.y, n.z), Terrain::AIR);
+
+  v.fill({n - glm::ivec3(4, 10, 4), n + glm::ivec3(5, 0, 5)}, Terrain::STONE);
+  v.set(n.x - 1, n.y - 1, n.z, Terrain::GRASS);
+  v.set(n.x, n.y - 1, n.z, Terrain::DIRT);
+  v.set(n.x, n.y, n.z, Terrain::AIR);
+  ASSERT_TRUE(Scheduler::randomTick(v, n - glm::ivec3(0, 1, 0)));
+  ASSERT_EQ(v(n.x, n.y - 1, n.z), Terrain::GRASS);
+}
+
+TEST(Mesh, greedy_quads_cover_the_same_faces) {
+  TestWorld t("minecraft_greedy", {44000, 100, 44000}, 3);
+  World& w = t.w;
+  glm::ivec2 center = t.center;
+  // some lamps, so faces differ in light as well
+  glm::ivec3 at {center.x * CHUNK_SIZE, 0, center.y * CHUNK_SIZE};
+  for (int n = 0; n < 20; ++n) {
+    w.set(at.x + n * 3, 70, at.z + n, Terrain::LAMP);
+  }
+
+  // every quad as the unit faces it covers: position, direction, block, light
+  using Face = std::array<int, 6>;
+  auto faces = [](const Mesh& mesh) {
+    std::vector<Face> faces;
+    for (const Instance& q : mesh) {
+      int n = q.direction() % 3;
+      for (int a = 0; a < q.width(); ++a)
+      for (int b = 0; b < q.height(); ++b) {
+        int p[3] = {q.x(), q.y(), q.z()};
+        p[(n + 1) % 3] += a;
+        p[(n + 2) % 3] += b;
+        faces.push_back({p[0], p[1], p[2], int(q.direction()), int(q.texture_index()), int(q.light())});
+      }
+    }
+    std::sort(faces.begin(), faces.end());
+    return faces;
+  };
+
+  size_t per_face = 0, greedy = 0, per_face_water = 0, greedy_water = 0;
+  for (int i = -2; i <= 2; ++i)
+  for (int k = -2; k <= 2; ++k) {
+    MeshJob job = w.snapshot(center + glm::ivec2(i, k));
+    job.greedy = false;
+    MeshResult one = job.run();
+    job.greedy = true;
+    MeshResult merged = job.run();
+    ASSERT_EQ(faces(one.instances), faces(merged.instances));
+    ASSERT_EQ(faces(one.water_instances), faces(merged.water_instances));
+    ASSERT_TRUE(std::all_of(one.instances.begin(), one.instances.end(), [](const Instance& q) { return q.width() == 1 && q.height() == 1; }));
+    // instances are in chunk coordinates: the chunk's origin puts every face back on its block
+    glm::ivec2 origin = (center + glm::ivec2(i, k)) * CHUNK_SIZE;
+    for (const Instance& q : merged.instances) {
+      ASSERT_EQ(w(origin.x + q.x(), q.y(), origin.y + q.z()), q.texture_index());
+    }
+    per_face += one.instances.size();
+    greedy += merged.instances.size();
+    per_face_water += one.water_instances.size();
+    greedy_water += merged.water_instances.size();
+  }
+  ASSERT_LT(greedy, per_face);
+  ASSERT_LE(greedy_water, per_face_water);
+}
+
+TEST(Mesh, padded_mesher_matches_a_voxel_by_voxel_reference) {
+  TestWorld t("minecraft_padded", {52000, 100, 52000}, 2);
+  World& w = t.w;
+  glm::ivec2 center = t.center;
+  // water and blocks right on the chunk borders, at the top and the bottom of the world
+  glm::ivec3 at {center.x * CHUNK_SIZE, 0, center.y * CHUNK_SIZE};
+  srand(42);
+  for (int n = 0; n < 400; ++n) {
+    glm::ivec3 q = at + glm::ivec3(rand() % 48 - 16, rand() % CHUNK_HEIGHT, rand() % 48 - 16);
+    if (n % 8 == 0) {
+      q.x = at.x + (n % 16 < 8 ? -1 : CHUNK_SIZE);
+    }
+    if (n % 16 == 1) {
+      q.y = n % 32 < 16 ? 0 : CHUNK_HEIGHT - 1;
+    }
+    const u_char blocks[] = {Terrain::WATER, Terrain::STONE, Terrain::LEAF, Terrain::AIR, Terrain::LAMP};
+    w.set(q.x, q.y, q.z, blocks[rand() % 5]);
+  }
+
+  // every face by asking the world about each neighbour of each block: position, direction, block, light
+  static constexpr int STEP[6][3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}, {-1, 0, 0}, {0, -1, 0}, {0, 0, -1}};
+  using Face = std::array<int, 6>;
+  auto reference = [&](glm::ivec2 chunk_index) {
+    std::vector<Face> opaque, liquid;
+    glm::ivec3 origin {chunk_index.x * CHUNK_SIZE, 0, chunk_index.y * CHUNK_SIZE};
+    for (int i = 0; i < CHUNK_SIZE; ++i)
+    for (int j = 0; j < CHUNK_HEIGHT; ++j)
+    for (int k = 0; k < CHUNK_SIZE; ++k) {
+      u_char block = w(origin.x + i, j, origin.z + k);
+      for (int d = 0; d < 6; ++d) {
+        glm::ivec3 n = origin + glm::ivec3(i + STEP[d][0], j + STEP[d][1], k + STEP[d][2]);
+        bool inside = n.y >= 0 && n.y < CHUNK_HEIGHT && w.hasChunk(World::toChunk(n));
+        u_char next = inside ? w(n.x, n.y, n.z) : Terrain::AIR;
+        u_char light = n.y < 0 ? 0 : inside ? w.chunk(World::toChunk(n))->light(World::toLocal(n).x, n.y, World::toLocal(n).z) : Light::SKY;
+        Face face {i, j, k, d, block, light};
+        if (Section::isOpaque(block) && not Section::isOpaque(next)) {
+          opaque.push_back(face);
+        }
+        if (Section::isLiquid(block) && not Section::isOpaque(next) && not Section::isLiquid(next)) {
+          liquid.push_back(face);
+        }
+      }
+    }
+    return std::make_pair(opaque, liquid);
+  };
+  auto faces = [](const Mesh& mesh) {
+    std::vector<Face> faces;
+    for (const Instance& f : mesh) {
+      faces.push_back({f.x(), f.y(), f.z(), int(f.direction()), int(f.texture_index()), int(f.light())});
+    }
+    std::sort(faces.begin(), faces.end());
+    return faces;
+  };
+
+  // the middle chunks, and two on the edge of what is loaded
+  for (int i = -1; i <= 2; ++i)
+  for (int k = -1; k <= 1; ++k) {
+    MeshJob job = w.snapshot(center + glm::ivec2(i, k));
+    job.greedy = false;
+    MeshResult result = job.run();
+    auto [opaque, liquid] = reference(job.chunk_index);
+    ASSERT_EQ(faces(result.instances), opaque);
+    ASSERT_EQ(faces(result.water_instances), liquid);
+  }
+}
+
+TEST(Mesh, workers_mesh_off_thread_and_drop_stale_results) {
+  TestWorld t("minecraft_mesh_workers", {60000, 100, 60000}, 2);
+  World& w = t.w;
+  glm::ivec2 center = t.center;
+
+  MeshWorkers workers {3};
+  std::vector<glm::ivec2> inner;
+  for (int i = -1; i <= 1; ++i)
+  for (int k = -1; k <= 1; ++k) {
+    inner.push_back(center + glm::ivec2(i, k));
+    ASSERT_TRUE(workers.submit(w, inner.back()));
+    ASSERT_FALSE(workers.submit(w, inner.back())); // once at a time
+  }
+  // an edit after the snapshots makes the center's mesh stale, whenever it comes back. it is nowhere near
+  // the center's sides, so the neighbours' meshes are still good
+  glm::ivec3 base {center.x * CHUNK_SIZE, 0, center.y * CHUNK_SIZE};
+  w.set(base.x + 8, CHUNK_HEIGHT - 1, base.z + 8, Terrain::STONE);
+
+  auto built = [&]() {
+    return std::all_of(inner.begin(), inner.end(), [&](glm::ivec2 c) { return w.chunk(c)->_state == Chunk::State::Built; });
+  };
+  auto start = std::chrono::steady_clock::now();
+  while (not built()) {
+    ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(10));
+    workers.drain(w);
+    for (glm::ivec2 c : inner) {
+      if (w.chunk(c)->_state < Chunk::State::Built) {
+        workers.submit(w, c);
+      }
+    }
+    std::this_thread::yield();
+  }
+  ASSERT_EQ(workers._stale, 1u);
+  ASSERT_EQ(workers._installed, 9u);
+
+  auto same = [](const Mesh& a, const Mesh& b) {
+    return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(Instance)) == 0;
+  };
+  for (glm::ivec2 c : inner) {
+    MeshResult now = w.snapshot(c).run();
+    ASSERT_TRUE(same(w.chunk(c)->_instances, now.instances));
+  }
+
+  // a bulk edit relights the chunk, which keeps drawing its old mesh until it is meshed again
+  Mesh before = w.chunk(center)->_instances;
+  w.fill({base + glm::ivec3(2, 90, 2), base + glm::ivec3(6, 94, 6)}, Terrain::STONE);
+  ASSERT_EQ(w.chunk(center)->_state, Chunk::State::Built);
+  ASSERT_TRUE(same(w.chunk(center)->_instances, before));
+  w.remesh();
+  ASSERT_EQ(w.chunk(center)->_dirty, 0u);
+  ASSERT_TRUE(same(w.chunk(center)->_instances, w.snapshot(center).run().instances));
+}
+
+TEST(Visibility, sections_behind_rock_are_not_drawn) {
+  // a wall across x cuts the section in two: the x faces no longer see each other, the rest still do
+  Section wall;
+  for (int j = 0; j < SECTION_SIZE; ++j)
+  for (int k = 0; k < SECTION_SIZE; ++k) {
+    wall.set(8, j, k, Terrain::STONE);
+  }
+  uint16_t graph = Visibility::graph(wall);
+  ASSERT_FALSE(Visibility::connected(graph, 0, 3));
+  ASSERT_TRUE(Visibility::connected(graph, 1, 4));
+  ASSERT_TRUE(Visibility::connected(graph, 0, 4));
+  ASSERT_TRUE(Visibility::connected(graph, 2, 3));
+  ASSERT_EQ(Visibility::graph(Section()), Visibility::ALL);
+
+  TestWorld t("minecraft_visibility", {68000, 100, 68000}, 4);
+  World& w = t.w;
+  glm::ivec2 center = t.center;
+  // a room deep in solid rock
+  glm::ivec3 room = glm::ivec3(center.x * CHUNK_SIZE, 20, center.y * CHUNK_SIZE) + glm::ivec3(8, 0, 8);
+  w.fill({room - glm::ivec3(10), room + glm::ivec3(10)}, Terrain::STONE);
+  w.fill({room - glm::ivec3(2), room + glm::ivec3(2)}, Terrain::AIR);
+  for (int i = -4; i <= 4; ++i)
+  for (int k = -4; k <= 4; ++k) {
+    w.buildChunk(center + glm::ivec2(i, k));
+  }
+
+  std::vector<Instance> instances;
+  std::vector<Draw> draws;
+  w.build(instances, draws);
+  size_t all = instances.size();
+
+  auto drawn = [&](glm::vec3 eye, glm::vec3 look) {
+    Visibility::Sections visible = Visibility::visible(w, eye, look);
+    w.build(instances, draws, &visible);
+    return instances.size();
+  };
+
+  // on the surface, looking along it
+  glm::ivec3 ground = room;
+  for (ground.y = CHUNK_HEIGHT - 1; w.isAir(ground.x, ground.y, ground.z); --ground.y) {}
+  size_t surface = drawn(glm::vec3(ground) + glm::vec3(0, 2, 0), glm::vec3(1, 0, 0));
+
+  // and from inside the room, which sees nothing past its walls
+  size_t cave = drawn(glm::vec3(room), glm::vec3(1, 0, 0));
+  Visibility::Sections visible = Visibility::visible(w, glm::vec3(room), glm::vec3(1, 0, 0));
+  ASSERT_TRUE(visible[center] >> (room.y / SECTION_SIZE) & 1);
+
+  ASSERT_LT(surface, all);
+  ASSERT_LT(cave * 20, all);
+}
+
+TEST(Visibility, faces_turned_away_are_not_sent) {
+  TestWorld t("minecraft_facing", {72000, 100, 72000}, 3);
+  World& w = t.w;
+  glm::ivec2 center = t.center;
+  for (int i = -2; i <= 2; ++i)
+  for (int k = -2; k <= 2; ++k) {
+    w.buildChunk(center + glm::ivec2(i, k));
+  }
+
+  // faces come out of the mesher by direction within each section, merged or not
+  for (bool greedy : {false, true}) {
+    MeshJob job = w.snapshot(center);
+    job.greedy = greedy;
+    MeshResult result = job.run();
+    ASSERT_TRUE(std::is_sorted(result.instances.begin(), result.instances.end(), [](const Instance& a, const Instance& b) {
+      return std::make_pair(a.y() / SECTION_SIZE, a.direction()) < std::make_pair(b.y() / SECTION_SIZE, b.direction());
+    }));
+  }
+
+  // standing on the ground in the middle
+  glm::ivec3 ground = t.p.blockPosition();
+  for (ground.y = CHUNK_HEIGHT - 1; w.isAir(ground.x, ground.y, ground.z); --ground.y) {}
+  glm::vec3 eye = glm::vec3(ground) + glm::vec3(0.3f, 2.6f, 0.2f);
+
+  // the faces that turn towards eye: the plane of the face is on the side of its block the normal points to
+  std::vector<Instance> instances;
+  std::vector<Draw> draws;
+  auto towards = [&]() {
+    size_t count = 0;
+    for (const Draw& draw : draws)
+    for (size_t q = draw.first; q < draw.first + draw.count; ++q) {
+      const Instance& face = instances[q];
+      int n = face.direction() % 3;
+      float sign = face.direction() < 3 ? 1 : -1;
+      glm::vec3 block = glm::vec3(draw.origin.x + face.x(), face.y(), draw.origin.y + face.z());
+      count += sign * (eye[n] - (block[n] + 0.5f * sign)) > 0;
+    }
+    return count;
+  };
+
+  w.build(instances, draws);
+  size_t all = instances.size(), all_towards = towards();
+  w.build(instances, draws, nullptr, &eye);
+  size_t sent = instances.size();
+  ASSERT_EQ(towards(), all_towards);
+  ASSERT_LT(sent * 10, all * 7);
+}
+
+TEST(Lod, far_chunks_draw_fewer_quads_and_close_their_seams) {
+  // further out switches right away, closer in one chunk past the line
+  ASSERT_EQ(Lod::level(0, 3), 0);
+  ASSERT_EQ(Lod::level(0, 4), 1);
+  ASSERT_EQ(Lod::level(0, 7), 2);
+  ASSERT_EQ(Lod::level(2, 5), 2);
+  ASSERT_EQ(Lod::level(2, 4), 1);
+  ASSERT_EQ(Lod::level(1, 3), 1);
+  ASSERT_EQ(Lod::level(1, 2), 0);
+
+  // a cell keeps the block on top of it, and is air if less than half of it is filled
+  Column column;
+  column.fill({{0, 0, 0}, {2, 1, 2}}, Terrain::DIRT);
+  column.fill({{0, 1, 0}, {2, 2, 2}}, Terrain::GRASS);
+  column.fill({{2, 0, 0}, {4, 1, 2}}, Terrain::STONE);
+  column.set(4, 0, 0, Terrain::STONE);
+  column.set(5, 0, 0, Terrain::STONE);
+  column.set(4, 0, 1, Terrain::STONE);
+  Column coarse = Lod::downsample(column, 1);
+  ASSERT_EQ(coarse.get(0, 0, 0), Terrain::GRASS);
+  ASSERT_EQ(coarse.get(1, 1, 1), Terrain::GRASS);
+  ASSERT_EQ(coarse.get(3, 1, 0), Terrain::STONE);
+  ASSERT_EQ(coarse.get(4, 0, 0), Terrain::AIR);
+
+  TestWorld t("minecraft_lod", {76000, 100, 76000}, 3);
+  World& w = t.w;
+  Player& p = t.p;
+  glm::ivec2 center = t.center;
+  for (int i = -2; i <= 2; ++i)
+  for (int k = -2; k <= 2; ++k) {
+    w.buildChunk(center + glm::ivec2(i, k));
+  }
+
+  // every level is a good deal smaller than the one before
+  std::array<size_t, LOD_LEVELS> quads {};
+  for (int i = -2; i <= 2; ++i)
+  for (int k = -2; k <= 2; ++k) {
+    glm::ivec2 chunk_index = center + glm::ivec2(i, k);
+    quads[0] += w.chunk(chunk_index)->_instances.size();
+    for (int level = 1; level < LOD_LEVELS; ++level) {
+      w.buildLod(chunk_index, level);
+      quads[level] += w.chunk(chunk_index)->_lods[level].instances.size();
+    }
+  }
+  ASSERT_LT(quads[1] * 2, quads[0]);
+  ASSERT_LT(quads[2] * 3, quads[1] * 2);
+
+  // a skirt is the faces out of the border that the neighbour's blocks hide
+  glm::ivec2 east = center + glm::ivec2(1, 0);
+  Column east_coarse = Lod::downsample(*w.chunk(east), 1);
+  const Mesh& skirt = w.chunk(east)->_lods[1].skirts[2];
+  ASSERT_FALSE(skirt.empty());
+  for (const Instance& face : skirt) {
+    ASSERT_EQ(face.direction(), 3u);
+    ASSERT_EQ(face.x(), 0);
+    for (int y = face.y(); y < face.y() + face.width(); ++y) {
+      ASSERT_TRUE(Terrain::has(east_coarse.get(0, y, face.z()), Terrain::OPAQUE));
+      ASSERT_TRUE(Terrain::has(w.chunk(center)->get(CHUNK_SIZE - 1, y, face.z()), Terrain::OPAQUE));
+    }
+  }
+
+  // four chunks east of here the middle ones are further than the first line, and get meshed at 2x
+  // a few a frame. nothing needs a level it does not have any more once that is done
+  p.setPos(glm::vec3(76000 + 4 * CHUNK_SIZE, 100, 76000));
+  w.handleTick(p);
+  for (int frame = 0; frame < 20; ++frame) {
+    w.remesh();
+  }
+  ASSERT_EQ(w.chunk(center)->_lod, 1);
+  ASSERT_EQ(w.chunk(center)->drawnLevel(), 1);
+  ASSERT_EQ(w.chunk(center + glm::ivec2(1, 0))->drawnLevel(), 0);
+  ASSERT_EQ(w.chunk(center)->_lods[1].versions, w.versions(center));
+
+  // an edit makes the level's meshes stale, and they are made again
+  glm::ivec3 block {center.x * CHUNK_SIZE + 8, 40, center.y * CHUNK_SIZE + 8};
+  w.set(block.x, block.y, block.z, Terrain::AIR == w(block.x, block.y, block.z) ? Terrain::STONE : Terrain::AIR);
+  ASSERT_NE(w.chunk(center)->_lods[1].versions, w.versions(center));
+  w.remesh();
+  ASSERT_EQ(w.chunk(center)->_lods[1].versions, w.versions(center));
+
+  // coming back a chunk stays coarse until it is a chunk past the line
+  p.setPos(glm::vec3(76000 + 3 * CHUNK_SIZE, 100, 76000));
+  w.handleTick(p);
+  w.remesh();
+  ASSERT_EQ(w.chunk(center)->_lod, 1);
+  p.setPos(glm::vec3(76000 + 2 * CHUNK_SIZE, 100, 76000));
+  w.handleTick(p);
+  w.remesh();
+  ASSERT_EQ(w.chunk(center)->_lod, 0);
+}
+
+// a measurement rather than a test, of what sharing section meshes would save: it does not run with the suite.
+// run it with --gtest_also_run_disabled_tests --gtest_filter=Mesh.DISABLED_section_dedup
+TEST(Mesh, DISABLED_section_dedup) {
+  for (glm::vec3 at : {glm::vec3(96000, 100, 96000), glm::vec3(52000, 100, 13000), glm::vec3(8000, 100, 88000)}) {
+    TestWorld t("minecraft_section_dedup", at, 4);
+    World& w = t.w;
+    // every non-empty section's mesh with y made relative to the section: equal voxels and light around
+    // them mesh to equal keys, so this finds at least the matches a key on the voxels would
+    std::unordered_map<std::string, int> seen;
+    size_t sections = 0, shared = 0, bytes = 0, saved = 0;
+    for (int i = -3; i <= 3; ++i)
+    for (int k = -3; k <= 3; ++k) {
+      MeshResult result = w.snapshot(t.center + glm::ivec2(i, k)).run();
+      for (const Mesh* mesh : {&result.instances, &result.water_instances}) {
+        for (int s = 0; s < SECTION_COUNT; ++s) {
+          std::string key(1, mesh == &result.water_instances);
+          for (const Instance& face : *mesh) {
+            if (face.y() / SECTION_SIZE == s) {
+              GLuint relative = face.face - (GLuint(s * SECTION_SIZE) << 8);
+              key.append(reinterpret_cast<const char*>(&relative), sizeof(relative));
+              key.append(reinterpret_cast<const char*>(&face.shade), sizeof(face.shade));
+            }
+          }
+          if (key.size() == 1) {
+            continue;
+          }
+          ++sections;
+          bytes += key.size() - 1;
+          if (seen[key]++ > 0) {
+            ++shared;
+            saved += key.size() - 1;
+          }
+        }
+      }
+    }
+    std::cout << at.x << " " << at.z << ": " << shared << " of " << sections << " sections have a mesh seen before ("
+              << 100 * shared / sections << "%), " << saved << " of " << bytes << " bytes of instances" << std::endl;
+  }
+}